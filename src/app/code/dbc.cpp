@@ -1,5 +1,7 @@
 #include "dbc.h"
 
+#include "run_queue.h"
+
 #include <thread>
 
 #include <asio.hpp>
@@ -11,10 +13,10 @@ std::string DbcUtils::make_string(asio::streambuf& streambuf)
 
 void IoServiceAwaiter::await_suspend(std::coroutine_handle<> h)
 {
-	std::jthread runner([this, h] 
+	std::jthread runner([this, h, executor = RunQueue::current()] 
 	{ 
 		count_ = srv_.run();
-		h.resume();
+		resume_on(executor, h);
 	});
 	
 	runner.detach();
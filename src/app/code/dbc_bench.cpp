@@ -0,0 +1,438 @@
+#include "timer_mgr.h"
+#include "game_srv.h"
+#include "host.h"
+#include "os.h"
+#include "task.h"
+#include "msg_queue.h"
+#include "frame_pool.h"
+#include "filesystem.h"
+#include "content_store.h"
+
+#include <new>
+#include <atomic>
+#include <cstdlib>
+#include <string>
+#include <string_view>
+#include <vector>
+#include <memory>
+#include <chrono>
+#include <functional>
+#include <algorithm>
+#include <print>
+#include <format>
+#include <tuple>
+
+/* Micro-benchmarks for the simulation core, runnable without a world or terminal.
+Run with no arguments to run everything, or name the benchmarks to run. */
+
+/* Every heap allocation in the process is counted, so benchmarks can report allocations per operation. */
+static std::atomic<std::size_t> g_num_allocs{0};
+
+void* operator new(std::size_t size)
+{
+	++g_num_allocs;
+	if (void* ptr = std::malloc(size ? size : 1))
+		return ptr;
+
+	throw std::bad_alloc{};
+}
+
+void operator delete(void* ptr) noexcept
+{
+	std::free(ptr);
+}
+
+void operator delete(void* ptr, std::size_t) noexcept
+{
+	std::free(ptr);
+}
+
+namespace DbcBench
+{
+	using Clock = std::chrono::steady_clock;
+
+	double elapsed_ms(Clock::time_point since)
+	{
+		return std::chrono::duration<double, std::milli>(Clock::now() - since).count();
+	}
+
+	/* Step cost with many pending timers that never expire during the run,
+	plus a few short ones expiring every step -- the usual mix of long timeouts and os.wait(). */
+	void timers_pending()
+	{
+		constexpr std::size_t num_pending = 100'000;
+		constexpr std::size_t num_steps = 1'000;
+
+		TimerManager timers{};
+		std::size_t fired = 0;
+
+		auto t_set = Clock::now();
+		for (std::size_t i = 0; i < num_pending; ++i)
+		{
+			timers.set_timer(timer_seconds(1000.f + static_cast<float>(i % 100)), [&fired]{ ++fired; });
+		}
+		double set_ms = elapsed_ms(t_set);
+
+		auto t_step = Clock::now();
+		for (std::size_t i = 0; i < num_steps; ++i)
+		{
+			for (int j = 0; j < 8; ++j)
+				timers.set_timer(TimerDuration::zero(), [&fired]{ ++fired; });
+
+			timers.step();
+		}
+		double step_ms = elapsed_ms(t_step);
+
+		std::println("timers_pending: {} pending timers set in {:.3f} ms.", num_pending, set_ms);
+		std::println("timers_pending: {} steps in {:.3f} ms ({:.3f} us/step, {} fired).", num_steps, step_ms, 1000.0 * step_ms / num_steps, fired);
+	}
+
+	/* A process-like coroutine sleeping on the OS timer in a loop. */
+	EagerTask<int32_t> sleeper(OS& os, std::size_t num_waits, std::size_t& woken)
+	{
+		for (std::size_t i = 0; i < num_waits; ++i)
+		{
+			co_await os.wait(0.f);
+			++woken;
+		}
+
+		co_return 0;
+	}
+
+	/* Heap allocations per wake-up of a process suspended in os.wait().
+	The coroutines are started (and their frames allocated) before counting begins. */
+	void os_wait_allocs()
+	{
+		constexpr std::size_t num_procs = 1'000;
+		constexpr std::size_t num_waits = 100;
+
+		TimerManager timers{};
+		GameServices services{timers};
+		Host host{"bench"};
+		OS os{host};
+		os.init(&services);
+
+		std::size_t woken = 0;
+		std::vector<EagerTask<int32_t>> procs{};
+		procs.reserve(num_procs);
+
+		for (std::size_t i = 0; i < num_procs; ++i)
+			procs.push_back(sleeper(os, num_waits, woken));
+
+		/* Let the first round of slots and queue storage settle. */
+		timers.step();
+
+		std::size_t allocs_before = g_num_allocs.load();
+		auto t_step = Clock::now();
+
+		while (timers.get_num_pending() > 0)
+			timers.step();
+
+		double step_ms = elapsed_ms(t_step);
+		std::size_t allocs = g_num_allocs.load() - allocs_before;
+
+		std::println("os_wait_allocs: {} wake-ups in {:.3f} ms, {} allocations ({:.4f} per wake-up).",
+			woken, step_ms, allocs, static_cast<double>(allocs) / static_cast<double>(std::max<std::size_t>(woken, 1)));
+	}
+
+	/* Mirrors the await chain of a socket read:
+	ProcNetApi::async_read_socket -> NetManager::async_read_socket -> _tcp -> _raw -> queue. */
+	Task<int32_t> read_raw(MessageQueue<int32_t>& queue)
+	{
+		co_return co_await queue.async_pop();
+	}
+
+	Task<int32_t> read_tcp(MessageQueue<int32_t>& queue)
+	{
+		co_return co_await read_raw(queue);
+	}
+
+	Task<int32_t> read_socket(MessageQueue<int32_t>& queue)
+	{
+		co_return co_await read_tcp(queue);
+	}
+
+	Task<int32_t> read_proc(MessageQueue<int32_t>& queue)
+	{
+		co_return co_await read_socket(queue);
+	}
+
+	EagerTask<int32_t> reader(MessageQueue<int32_t>& queue, std::size_t num_reads, int64_t& sum)
+	{
+		for (std::size_t i = 0; i < num_reads; ++i)
+			sum += co_await read_proc(queue);
+
+		co_return 0;
+	}
+
+	/* Cost of a read that suspends four coroutine frames deep, then is resumed by a push. */
+	void nested_await()
+	{
+		constexpr std::size_t num_reads = 1'000'000;
+
+		MessageQueue<int32_t> queue{};
+		int64_t sum = 0;
+
+		std::size_t frames_before = FramePool::get_stats().live;
+		std::size_t allocs_before = g_num_allocs.load();
+		auto t_read = Clock::now();
+
+		/* Scoped task */
+		{
+			EagerTask<int32_t> task = reader(queue, num_reads, sum);
+
+			for (std::size_t i = 0; i < num_reads; ++i)
+				queue.push(1);
+		}
+
+		double read_ms = elapsed_ms(t_read);
+		std::size_t allocs = g_num_allocs.load() - allocs_before;
+		std::size_t frames_left = FramePool::get_stats().live - frames_before;
+
+		std::println("nested_await: {} reads in {:.3f} ms ({:.1f} ns/read, sum {}), {} allocations ({:.4f} per read), {} frames left.",
+			num_reads, read_ms, 1'000'000.0 * read_ms / num_reads, sum, allocs, static_cast<double>(allocs) / num_reads, frames_left);
+	}
+
+	/* A file system of 100 directories with 1000 files each. */
+	void make_tree(FileSystem& fs, std::size_t num_dirs, std::size_t num_files)
+	{
+		for (std::size_t d = 0; d < num_dirs; ++d)
+		{
+			std::string dir = std::format("/d{}", d);
+			fs.create_directory(dir, {});
+
+			for (std::size_t f = 0; f < num_files; ++f)
+				fs.create_file(std::format("{}/f{}", dir, f), { .content = "x" });
+		}
+	}
+
+	/* Cost of a recursive listing, and of the per-entry lookups 'ls -lR' makes on it. */
+	void fs_list()
+	{
+		constexpr std::size_t num_iters = 10;
+
+		FileSystem fs{};
+
+		auto t_make = Clock::now();
+		make_tree(fs, 100, 1000);
+		double make_ms = elapsed_ms(t_make);
+
+		std::size_t num_files = 0;
+		auto t_files = Clock::now();
+
+		for (std::size_t i = 0; i < num_iters; ++i)
+			num_files = fs.get_files(fs.get_root(), true).size();
+
+		double files_ms = elapsed_ms(t_files) / num_iters;
+
+		std::size_t num_walked = 0;
+		std::size_t allocs_before = g_num_allocs.load();
+		auto t_walk = Clock::now();
+
+		for (std::size_t i = 0; i < num_iters; ++i)
+		{
+			num_walked = 0;
+			for (NodeIdx fid : fs.walk(fs.get_root()))
+				num_walked += (fid != 0);
+		}
+
+		double walk_ms = elapsed_ms(t_walk) / num_iters;
+		std::size_t walk_allocs = g_num_allocs.load() - allocs_before;
+
+		std::size_t checksum = 0;
+		auto t_list = Clock::now();
+
+		for (std::size_t i = 0; i < num_iters; ++i)
+		{
+			for (NodeIdx fid : fs.get_files(fs.get_root(), true))
+			{
+				checksum += fs.get_links(fid) + fs.get_bytes(fid) + fs.get_flags(fid).size();
+				checksum += fs.get_owner(fid).first + fs.get_mdate(fid).size();
+				checksum += fs.is_dir(fid) + fs.get_filename(fid).size();
+			}
+		}
+
+		double list_ms = elapsed_ms(t_list) / num_iters;
+
+		std::println("fs_list: {} files made in {:.3f} ms.", num_files, make_ms);
+		std::println("fs_list: get_files(recurse) in {:.3f} ms, ls -lR lookups in {:.3f} ms (checksum {}).", files_ms, list_ms, checksum);
+		std::println("fs_list: walk over {} files in {:.3f} ms, {} allocations.", num_walked, walk_ms, walk_allocs);
+	}
+
+	/* Cost of 'rm -r' through the asking callback, on a flat and on a deep tree. */
+	void fs_remove()
+	{
+		FileSystem fs{};
+		make_tree(fs, 100, 1000);
+
+		std::string deep = "/deep";
+		for (std::size_t i = 0; i < 1000; ++i)
+		{
+			fs.create_directory(deep, {});
+			deep += "/d";
+		}
+
+		std::size_t num_removed = 0;
+		auto count_removed = [&num_removed](const FileSystem&, const FilePath&, std::error_condition err)
+		{
+			num_removed += (err.value() == 0);
+			return true;
+		};
+
+		auto t_flat = Clock::now();
+		for (std::size_t d = 0; d < 100; ++d)
+			fs.remove_file(FilePath{std::format("/d{}", d)}, count_removed);
+
+		double flat_ms = elapsed_ms(t_flat);
+
+		auto t_deep = Clock::now();
+		fs.remove_file(FilePath{"/deep"}, count_removed);
+		double deep_ms = elapsed_ms(t_deep);
+
+		std::println("fs_remove: {} files removed, flat tree in {:.3f} ms, 1000 deep in {:.3f} ms, {} left.",
+			num_removed, flat_ms, deep_ms, fs.get_links(fs.get_root()));
+	}
+
+	/* Appending log lines through an open handle, as '/var/log/rx.log' is written. */
+	void fs_append()
+	{
+		constexpr std::size_t num_lines = 1'000'000;
+
+		FileSystem fs{};
+		auto [fid, file, err] = fs.create_file("/log", {});
+		OpenFileHandle handle = fs.open_file_entry(fid, FileAccessFlags::Write | FileAccessFlags::Append).first;
+
+		const std::string line = "rx: 192.168.0.2 -> 192.168.0.1 (64 bytes)\n";
+
+		std::size_t allocs_before = g_num_allocs.load();
+		auto t_append = Clock::now();
+
+		for (std::size_t i = 0; i < num_lines; ++i)
+			std::ignore = fs.write(handle, line);
+
+		double append_ms = elapsed_ms(t_append);
+		std::size_t allocs = g_num_allocs.load() - allocs_before;
+
+		std::println("fs_append: {} appends in {:.3f} ms ({:.1f} ns/append), {} bytes, {:.4f} allocations per append.",
+			num_lines, append_ms, 1'000'000.0 * append_ms / num_lines, file->size(), static_cast<double>(allocs) / num_lines);
+
+		fs.close_file_entry(handle);
+	}
+
+	/* Many file systems given the same binary and configs, as client bootstrap does for every host. */
+	void fs_dedup()
+	{
+		constexpr std::size_t num_hosts = 1000;
+
+		std::string binary(64 * 1024, '\0');
+		for (std::size_t i = 0; i < binary.size(); ++i)
+			binary[i] = static_cast<char>(i * 31 % 251);
+
+		const std::string config = std::string(512, '#') + "\nport=22\n";
+
+		std::vector<std::unique_ptr<FileSystem>> hosts{};
+		hosts.reserve(num_hosts);
+
+		auto t_make = Clock::now();
+
+		for (std::size_t i = 0; i < num_hosts; ++i)
+		{
+			auto& fs = hosts.emplace_back(std::make_unique<FileSystem>());
+			std::ignore = fs->create_file("/bin/join", { .recurse = true, .content = binary });
+			std::ignore = fs->create_file("/etc/sshd.conf", { .recurse = true, .content = config });
+			std::ignore = fs->create_file("/etc/hostname", { .recurse = true, .content = std::format("host-{}", i) });
+		}
+
+		double make_ms = elapsed_ms(t_make);
+		ContentStore::ContentStats stats = ContentStore::get_stats();
+
+		std::println("fs_dedup: {} hosts made in {:.3f} ms; {} chunks, {} bytes stored for {} referenced (ratio {:.1f}).",
+			num_hosts, make_ms, stats.num_chunks, stats.stored_bytes, stats.referenced_bytes, stats.dedup_ratio());
+	}
+
+	/* Host file systems built from scratch, against ones made from a frozen base image and then given a few changes of their own. */
+	void fs_overlay()
+	{
+		constexpr std::size_t num_hosts = 1000;
+
+		auto make_skeleton = [](FileSystem& fs)
+		{
+			for (std::string_view dir : { "/dev", "/bin", "/etc", "/home", "/lib", "/sbin", "/tmp", "/var/log", "/var/tmp", "/usr/bin", "/usr/lib", "/usr/share" })
+				std::ignore = fs.create_directory(dir, { .recurse = true });
+
+			for (std::size_t i = 0; i < 32; ++i)
+				std::ignore = fs.create_file(std::format("/bin/prog{}", i), { .content = "BIN64::" });
+
+			std::ignore = fs.create_file("/etc/group", { .content = std::string(300, 'g') });
+		};
+
+		auto make_changes = [](FileSystem& fs)
+		{
+			std::ignore = fs.create_directory("/home/user", { .recurse = true });
+			std::ignore = fs.create_file("/etc/passwd", { .content = "root:x:0:0::/:/bin/shell" });
+			std::ignore = fs.remove_file("/var/tmp");
+		};
+
+		std::vector<std::unique_ptr<FileSystem>> hosts{};
+		hosts.reserve(num_hosts);
+
+		std::size_t allocs_before = g_num_allocs.load();
+		auto t_full = Clock::now();
+
+		for (std::size_t i = 0; i < num_hosts; ++i)
+		{
+			auto& fs = hosts.emplace_back(std::make_unique<FileSystem>());
+			make_skeleton(*fs);
+			make_changes(*fs);
+		}
+
+		double full_ms = elapsed_ms(t_full);
+		std::size_t full_allocs = g_num_allocs.load() - allocs_before;
+		hosts.clear();
+
+		FileSystem base{};
+		make_skeleton(base);
+		base.freeze();
+
+		allocs_before = g_num_allocs.load();
+		auto t_overlay = Clock::now();
+
+		for (std::size_t i = 0; i < num_hosts; ++i)
+		{
+			auto& fs = hosts.emplace_back(std::make_unique<FileSystem>());
+			fs->use_base(base);
+			make_changes(*fs);
+		}
+
+		double overlay_ms = elapsed_ms(t_overlay);
+		std::size_t overlay_allocs = g_num_allocs.load() - allocs_before;
+
+		std::println("fs_overlay: {} hosts built in {:.3f} ms ({} allocations), from a base image in {:.3f} ms ({} allocations).",
+			num_hosts, full_ms, full_allocs, overlay_ms, overlay_allocs);
+	}
+}
+
+int main(int argc, char* argv[])
+{
+	std::vector<std::pair<std::string_view, std::function<void()>>> benchmarks =
+	{
+		{"timers_pending", DbcBench::timers_pending},
+		{"os_wait_allocs", DbcBench::os_wait_allocs},
+		{"nested_await", DbcBench::nested_await},
+		{"fs_list", DbcBench::fs_list},
+		{"fs_remove", DbcBench::fs_remove},
+		{"fs_append", DbcBench::fs_append},
+		{"fs_dedup", DbcBench::fs_dedup},
+		{"fs_overlay", DbcBench::fs_overlay},
+	};
+
+	std::vector<std::string_view> selected(argv + 1, argv + argc);
+
+	for (auto& [name, fn] : benchmarks)
+	{
+		if (selected.empty() || std::ranges::find(selected, name) != selected.end())
+			fn();
+	}
+
+	return 0;
+}
@@ -122,9 +122,9 @@ int main(int argc, char* argv[])
 		}
 	};
 
-	ReaderFn local_reader = [q = queue_ptr](const Proc&) -> Task<ReadResult>
+	ReaderFn local_reader = [q = queue_ptr](const Proc&, std::stop_token stop) -> Task<ReadResult>
 	{
-		co_return (co_await q->async_pop());
+		co_return (co_await q->async_pop(std::move(stop)));
 	};
 
 	int32_t shell_pid{-1};
@@ -228,7 +228,7 @@ public:
 	asio::io_context& context_;
 	asio::steady_timer timer_;
 	tcp::socket socket_;
-	NetQueue write_queue_{};
+	MessageQueue<ip::IpPackage> write_queue_{};
 
 };
 
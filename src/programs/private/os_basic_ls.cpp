@@ -97,7 +97,7 @@ ProcessTask Programs::CmdList(Proc& proc, std::vector<std::string> args)
 		format.w_mdate = std::max(format.w_mdate, data.mdate.size());
 	};
 
-	auto get_list_data = [&fs, &users](uint64_t fid, const FilePath& path) -> LsListData
+	auto get_list_data = [&fs, &users](uint64_t fid) -> LsListData
 	{
 		LsListData data{};
 		if (fid != 0)
@@ -113,7 +113,7 @@ ProcessTask Programs::CmdList(Proc& proc, std::vector<std::string> args)
 
 			data.mdate = fs->get_mdate(fid);
 			data.is_dir = fs->is_dir(fid);
-			data.name = path.get_name();
+			data.name = fs->get_filename(fid);
 		}
 		return data;
 	};
@@ -157,22 +157,32 @@ ProcessTask Programs::CmdList(Proc& proc, std::vector<std::string> args)
 		if (path.is_relative())
 			path.prepend(wd);
 
-		LsListDataWidth widths{};
-		std::vector<LsListData> data{};
-		for (const auto& path : fs->get_paths(path, params.recurse))
+		NodeIdx dir = fs->get_fid(path);
+		if (!fs->is_dir(dir))
+			dir = 0;
+
+		/* Hidden and backup files are skipped along with anything below them. */
+		auto filter = [&fs, &params](NodeIdx fid)
 		{
-			uint64_t fid = fs->get_fid(path);
+			std::string_view name = fs->get_filename(fid);
+
+			if (name.empty())
+				return WalkStep::Skip;
 
-			if (fid == 0)
-				continue;
+			if (name.back() == '~' && params.ignore_backups)
+				return WalkStep::Skip;
 
-			if (path.is_backup() && params.ignore_backups)
-				continue;
+			if (name.front() == '.' && !params.show_all)
+				return WalkStep::Skip;
 
-			if (path.is_config() && !params.show_all)
-				continue;
+			return params.recurse ? WalkStep::Enter : WalkStep::Visit;
+		};
 
-			LsListData item = get_list_data(fid, path);
+		LsListDataWidth widths{};
+		std::vector<LsListData> data{};
+		for (NodeIdx fid : fs->walk(dir, WalkOrder::PreOrder, filter))
+		{
+			LsListData item = get_list_data(fid);
 			expand_format(item, widths);
 			data.emplace_back(std::move(item));
 		}
@@ -61,9 +61,9 @@ ProcessTask Programs::SrvNetRx(Proc& proc, std::vector<std::string> args)
 			{
 				net->receive(std::move(packet), src_ip, dest_ip);
 			}
-			else
+			else if (!net->send(std::move(packet)))
 			{
-				net->send(std::move(packet));
+				proc.warnln("Dropping packet to {} (transmit queue full).", dest_ip);
 			}
 		}
 		else
@@ -63,14 +63,18 @@ ProcessTask Programs::SrvNetTx(Proc& proc, std::vector<std::string> args)
 
 				if (std::optional<Uid64> arp_entry = net->arp_lookup(dest_addr); arp_entry.has_value())
 				{
-					net->send(std::move(packet), *arp_entry);
+					if (!net->send(std::move(packet), *arp_entry))
+						proc.warnln("Dropping packet to {} (receiver busy).", dest_addr);
+
 					continue;
 				}
 				else
 				{
 					proc.putln("Performing ARP request (to find {})...", dest_addr);
 					net->arp_request();
-					net->route(std::move(packet));
+					if (!net->route(std::move(packet)))
+						proc.warnln("Dropping packet to {} (routing queue full).", dest_addr);
+
 					continue;
 				}
 			}
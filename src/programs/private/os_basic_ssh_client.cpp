@@ -27,7 +27,10 @@ EagerTask<int32_t> SshReader(Proc& proc, FileDescriptor fd)
 
 	while (netapi.socket_is_open(fd))
 	{
-		auto exp_read = co_await when_any(netapi.async_read_socket(fd), proc.wait(3));
+		/* Without the stop, a read that lost would stay queued on the socket. The timer and the signal are
+		raced bare (rather than through proc.wait) so that they are cancelled when the read wins. */
+		std::stop_source stop{};
+		auto exp_read = co_await when_any(stop, netapi.async_read_socket(fd, stop.get_token()), proc.owning_os->wait(3), ProcSignalAwaiter{&proc});
 		if (exp_read.index == 0)
 		{
 			if (auto res = std::get<1>(exp_read.value))
@@ -40,14 +43,13 @@ EagerTask<int32_t> SshReader(Proc& proc, FileDescriptor fd)
 				break;
 			}
 		}
+		else if (exp_read.index == 2)
+		{
+			proc.warnln("ssh: Reader abort: interrupted (signal {}). Exiting.", std::get<3>(exp_read.value));
+			break;
+		}
 		else if (exp_read.index == 1)
 		{
-			if (auto res = std::get<2>(exp_read.value))
-			{
-				proc.warnln("ssh: Reader abort: {}. Exiting.", res.message());
-				break;
-			}
-
 			if (co_await netapi.async_socket_test_alive(fd, 3))
 			{
 				continue;
@@ -146,7 +148,11 @@ ProcessTask Programs::CmdSshClient(Proc& proc, std::vector<std::string> args)
 			continue;
 		}
 
-		co_await proc.net.async_write_socket(fd, *exp_msg);
+		if (co_await proc.net.async_write_socket(fd, *exp_msg) == 0)
+		{
+			proc.errln("ssh: Write failure: connection lost. Exiting.");
+			co_return 2;
+		}
 	}
 	
 	co_return 0;
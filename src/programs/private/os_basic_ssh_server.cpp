@@ -87,9 +87,9 @@ ProcessTask Programs::CmdSshServer(Proc& proc, std::vector<std::string> args)
 		proc.putln("Connection established ({}).", con);
 		proc.set_var("SSHCON", con);
 	
-		auto sess_reader = [con](const Proc& rproc) -> Task<ReadResult>
+		auto sess_reader = [con](const Proc& rproc, std::stop_token stop) -> Task<ReadResult>
 		{
-			return rproc.net.async_read_socket(con);
+			return rproc.net.async_read_socket(con, std::move(stop));
 		};
 	
 		auto sess_writer = [con](const Proc& wproc, const std::string& str)
@@ -98,8 +98,12 @@ ProcessTask Programs::CmdSshServer(Proc& proc, std::vector<std::string> args)
 			rep.set_reply(str);
 			
 			std::string out_str;
-			if (rep.SerializeToString(&out_str))
-				wproc.net.async_write_socket(con, out_str);
+			if (not rep.SerializeToString(&out_str))
+				return;
+
+			/* Not awaited, since a writer can't suspend; the write waits for room in the tx queue on its own.
+			If it has to give up, the connection is closed, which the session sees on its next read. */
+			wproc.net.async_write_socket(con, std::move(out_str));
 		};
 	
 		OS::CreateProcessParams params
@@ -1,8 +1,9 @@
 #include "timer_awaiter.h"
 #include "timer_base.h"
+#include "run_queue.h"
 
-TimerAwaiter::TimerAwaiter(ITimerBase* mgr, float seconds)
-	: mgr_(mgr), time_(seconds) { }
+TimerAwaiter::TimerAwaiter(ITimerBase* mgr, TimerDuration length)
+	: mgr_(mgr), length_(length) { }
 
 bool TimerAwaiter::await_ready() const
 {
@@ -14,7 +15,16 @@ float TimerAwaiter::await_resume() const
     return 0.0f;
 }
 
-void TimerAwaiter::await_suspend(std::coroutine_handle<> h) const
+void TimerAwaiter::await_suspend(std::coroutine_handle<> h)
 {
-	mgr_->set_timer(time_, [h]{ h.resume(); });
+	/* The handle is written under the manager's lock: once the timer is staged it may fire on the
+	stepping thread and resume (or free) this frame before set_timer would have returned. */
+	mgr_->set_timer(length_, { h, RunQueue::current() }, handle_);
+}
+
+bool TimerAwaiter::cancel()
+{
+	/* Read under the same lock, so a cancel racing await_suspend sees either no timer or the whole handle.
+	The handle is left as is; once the timer is dead its generation has moved on. */
+	return mgr_->cancel_timer(handle_);
 }
\ No newline at end of file
@@ -1,20 +1,35 @@
 #pragma once
 
+#include "timer_types.h"
+
 #include <coroutine>
 
 class ITimerBase;
 
+/* A slot index plus the generation of the slot when the timer was set.
+Once the timer fires or is cancelled the generation moves on, so old handles can't touch a reused slot. */
+struct TimerHandle
+{
+	int32_t idx{-1};
+	uint32_t gen{0};
+};
+
 struct TimerAwaiter
 {
-	explicit TimerAwaiter(ITimerBase* mgr, float seconds);
+	explicit TimerAwaiter(ITimerBase* mgr, TimerDuration length);
 
 	bool await_ready() const;
-	void await_suspend(std::coroutine_handle<> h) const;
+	void await_suspend(std::coroutine_handle<> h);
 	float await_resume() const;
 
+	/* Withdraw a pending wait, so the timer slot is freed and the awaiting coroutine is never resumed.
+	Returns false if there was nothing to cancel (not yet suspended, or already fired). */
+	bool cancel();
+
 private:
 
 	ITimerBase* mgr_;
-	float time_{0};
+	TimerDuration length_{0};
+	TimerHandle handle_{};
 
 };
\ No newline at end of file
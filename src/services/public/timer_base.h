@@ -1,36 +1,73 @@
 #pragma once
 
+#include "timer_types.h"
 #include "timer_awaiter.h"
+#include "run_queue.h"
 
 #include <functional>
+#include <coroutine>
+#include <concepts>
+#include <type_traits>
 
-struct TimerHandle
+/* A move-only timer event. Resuming a coroutine (every os.wait()) is the common case,
+so a bare coroutine handle is stored as-is, along with the run queue to resume it on;
+anything else goes in a move_only_function, which keeps small closures inline. */
+class TimerCallbackFn
 {
-	int32_t idx{-1};
-};
+public:
+
+	TimerCallbackFn() = default;
+	TimerCallbackFn(std::nullptr_t) { }
+	TimerCallbackFn(std::coroutine_handle<> handle, RunQueue* executor = nullptr) : handle_(handle), executor_(executor) { }
+
+	template<typename Fn>
+	requires (!std::same_as<std::remove_cvref_t<Fn>, TimerCallbackFn>) && std::invocable<std::decay_t<Fn>&>
+	TimerCallbackFn(Fn&& fn) : fn_(std::forward<Fn>(fn)) { }
+
+	TimerCallbackFn(TimerCallbackFn&&) noexcept = default;
+	TimerCallbackFn& operator = (TimerCallbackFn&&) noexcept = default;
+
+	void operator () ()
+	{
+		if (handle_)
+			resume_on(executor_, handle_);
+		else if (fn_)
+			fn_();
+	}
 
-using TimerCallbackFn = std::function<void(void)>;
+	explicit operator bool() const noexcept { return handle_ || fn_; }
+
+private:
+
+	std::coroutine_handle<> handle_{};
+	RunQueue* executor_{nullptr};
+	std::move_only_function<void(void)> fn_{};
+};
 
 class ITimerBase
 {
 public:
 
-	/* Set a timer (in seconds), giving a timer handle back. 
-	The event callback will be called once the timer reaches 0. */
-	virtual TimerHandle set_timer(float seconds, TimerCallbackFn event, bool looping = false) = 0;
+	/* Set a timer, giving a timer handle back. 
+	The event callback will be called once the length has passed. */
+	virtual TimerHandle set_timer(TimerDuration length, TimerCallbackFn event, bool looping = false) = 0;
+
+	/* As above, but the handle is written to 'out' under the manager's lock, before the timer can fire.
+	For callers whose storage may be gone by the time set_timer returns, such as a resumed coroutine frame. */
+	virtual void set_timer(TimerDuration length, TimerCallbackFn event, TimerHandle& out) = 0;
 
 	/* Pause a set timer without cancelling it. 
 	If the handle is invalid, nothing happens. */
 	virtual void pause_timer(const TimerHandle& handle) = 0;
 
-	/* Cancel a timer.
-	If the handle is invalid, nothing happens. */
-	virtual void cancel_timer(const TimerHandle& handle) = 0;
+	/* Cancel a timer, so that its callback is never called.
+	Returns false if the handle is invalid or the timer is no longer pending. */
+	virtual bool cancel_timer(const TimerHandle& handle) = 0;
 
-	/* Check if this is a valid timer handle.*/
+	/* Check if this handle refers to a timer that is still set. */
 	virtual bool is_valid_handle(const TimerHandle& handle) = 0;
 
 	/* Wait for this timer using a coroutine awaiter. */
-	virtual TimerAwaiter wait(float seconds) = 0;
+	virtual TimerAwaiter wait(TimerDuration length) = 0;
 
 };
\ No newline at end of file
@@ -0,0 +1,13 @@
+#pragma once
+
+#include <chrono>
+
+using TimerClock = std::chrono::steady_clock;
+using TimerDuration = TimerClock::duration;
+using TimerTimePoint = TimerClock::time_point;
+
+/* Converts a length in (game-facing, floating point) seconds to a timer duration. */
+inline TimerDuration timer_seconds(float seconds)
+{
+	return std::chrono::duration_cast<TimerDuration>(std::chrono::duration<float>(seconds));
+}
@@ -0,0 +1,85 @@
+#include "content_store.h"
+
+#include "sha256.h"
+
+#include <array>
+#include <cstdint>
+#include <cstring>
+#include <mutex>
+#include <unordered_map>
+#include <algorithm>
+
+namespace
+{
+	using Digest = std::array<uint8_t, 32>;
+
+	struct DigestHash
+	{
+		/* The digest is already uniformly distributed; any eight bytes of it will do. */
+		std::size_t operator()(const Digest& digest) const
+		{
+			std::size_t out{};
+			std::memcpy(&out, digest.data(), sizeof(out));
+			return out;
+		}
+	};
+
+	constexpr std::size_t min_sweep_at = 1024;
+
+	std::mutex store_lock{};
+	std::unordered_map<Digest, std::shared_ptr<std::string>, DigestHash> store{};
+
+	/* Chunks no file holds any more are dropped when the table has doubled since the last sweep. */
+	std::size_t sweep_at = min_sweep_at;
+
+	void sweep()
+	{
+		std::erase_if(store, [](const auto& pair) { return pair.second.use_count() == 1; });
+		sweep_at = std::max(min_sweep_at, 2 * store.size());
+	}
+}
+
+void ContentStore::intern(std::shared_ptr<std::string>& chunk)
+{
+	if (!chunk || chunk->size() < min_size)
+		return;
+
+	SHA256 sha{};
+	sha.update(std::string_view(*chunk));
+	Digest digest = sha.digest();
+
+	/* Scoped lock */
+	{
+		std::lock_guard lock(store_lock);
+
+		if (store.size() >= sweep_at)
+			sweep();
+
+		auto [it, inserted] = store.try_emplace(digest, chunk);
+		if (!inserted)
+			chunk = it->second;
+	}
+}
+
+ContentStore::ContentStats ContentStore::get_stats()
+{
+	ContentStats stats{};
+
+	/* Scoped lock */
+	{
+		std::lock_guard lock(store_lock);
+
+		for (const auto& [digest, chunk] : store)
+		{
+			std::size_t refs = static_cast<std::size_t>(chunk.use_count()) - 1;
+			if (refs == 0)
+				continue;
+
+			stats.num_chunks += 1;
+			stats.stored_bytes += chunk->size();
+			stats.referenced_bytes += chunk->size() * refs;
+		}
+	}
+
+	return stats;
+}
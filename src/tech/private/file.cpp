@@ -1,5 +1,7 @@
 #include "file.h"
 
+#include <cassert>
+
 std::size_t File::size() const
 {
 	return content_.size();
@@ -8,45 +10,117 @@ std::size_t File::size() const
 void File::write(ProcessFn exec)
 {
 	executable_ = std::move(exec);
-	content_ = "BIN64::";
+	content_.assign("BIN64::");
+	invalidate_flat();
 }
 
 void File::write(std::string content)
 {
-	content_ = std::move(content);
+	content_.assign(std::move(content));
+	invalidate_flat();
+}
+
+void File::intern()
+{
+	content_.intern();
 }
 
 std::optional<std::string> File::read() const
 {
-	return content_;
+	return content_.flatten();
 }
 
 std::optional<std::string> File::eat()
 {
-	return std::move(content_);
+	std::string out = content_.flatten();
+	content_.clear();
+	invalidate_flat();
+	return out;
 }
 
 void File::append(std::string content)
 {
-	content_.append(std::move(content));
+	content_.append(content);
+	invalidate_flat();
+}
+
+std::string File::pread(std::size_t offset, std::size_t bytes) const
+{
+	return content_.read(offset, bytes);
+}
+
+std::size_t File::pwrite(std::size_t offset, std::string_view data)
+{
+	std::size_t written = content_.write(offset, data);
+	invalidate_flat();
+	return written;
+}
+
+std::string_view File::view(std::size_t offset, std::size_t bytes) const
+{
+	return content_.view(offset, bytes);
 }
 
 std::string_view File::get_view() const
 {
-	return std::string_view(content_);
+	if (auto whole = content_.contiguous_view())
+		return *whole;
+
+	return std::string_view(get_string());
 }
 
 std::stringstream File::get_stream() const
 {
-	return std::stringstream(content_);
+	return std::stringstream(get_string());
 }
 
 const std::string& File::get_string() const
 {
-	return content_;
+	if (const std::string* whole = content_.contiguous())
+		return *whole;
+
+	if (!flat_valid_)
+	{
+		flat_ = content_.flatten();
+		flat_valid_ = true;
+	}
+
+	return flat_;
 }
 
 const ProcessFn& File::get_executable() const
 {
 	return executable_;
+}
+
+void File::set_content(FileContent content)
+{
+	content_ = std::move(content);
+	invalidate_flat();
+}
+
+void File::freeze()
+{
+	/* Join the content now, so that reads from hosts on other threads never have to fill the cache. */
+	get_string();
+	frozen_ = true;
+}
+
+std::shared_ptr<File> File::clone() const
+{
+	auto out = std::make_shared<File>(fid_);
+	out->content_ = content_;
+	out->executable_ = executable_;
+	return out;
+}
+
+void File::invalidate_flat()
+{
+	assert(!frozen_);
+
+	if (flat_valid_)
+	{
+		flat_ = std::string{};
+		flat_valid_ = false;
+	}
 }
\ No newline at end of file
@@ -0,0 +1,186 @@
+#include "file_content.h"
+#include "content_store.h"
+
+#include <algorithm>
+#include <utility>
+
+void FileContent::assign(std::string data)
+{
+	clear();
+
+	/* A small write is adopted as the only chunk, without a copy. */
+	if (data.size() <= chunk_size)
+	{
+		if (!data.empty())
+		{
+			size_ = data.size();
+			chunks_.push_back(std::make_shared<std::string>(std::move(data)));
+		}
+		return;
+	}
+
+	append(data);
+}
+
+void FileContent::clear()
+{
+	chunks_.clear();
+	size_ = 0;
+	owner_ = nullptr;
+	external_ = {};
+}
+
+void FileContent::assign_external(std::shared_ptr<const void> owner, std::string_view data)
+{
+	clear();
+	owner_ = std::move(owner);
+	external_ = data;
+	size_ = data.size();
+}
+
+void FileContent::intern()
+{
+	for (auto& chunk : chunks_)
+		ContentStore::intern(chunk);
+}
+
+void FileContent::append(std::string_view data)
+{
+	if (owner_)
+		internalise();
+
+	while (!data.empty())
+	{
+		if (chunks_.empty() || chunks_.back()->size() == chunk_size)
+			chunks_.push_back(std::make_shared<std::string>());
+
+		std::string& tail = writable_chunk(chunks_.size() - 1);
+		std::size_t n = std::min(chunk_size - tail.size(), data.size());
+
+		/* Grow geometrically, but never past a chunk, so a tail chunk is moved at most a few times. */
+		if (tail.capacity() < tail.size() + n)
+			tail.reserve(std::min(chunk_size, std::max(tail.size() + n, 2 * tail.capacity())));
+
+		tail.append(data.substr(0, n));
+		data.remove_prefix(n);
+		size_ += n;
+	}
+}
+
+std::string FileContent::read(std::size_t offset, std::size_t bytes) const
+{
+	std::string out{};
+	if (offset >= size_)
+		return out;
+
+	bytes = std::min(bytes, size_ - offset);
+	out.reserve(bytes);
+
+	while (out.size() < bytes)
+		out.append(view(offset + out.size(), bytes - out.size()));
+
+	return out;
+}
+
+std::size_t FileContent::write(std::size_t offset, std::string_view data)
+{
+	if (owner_)
+		internalise();
+
+	if (offset > size_)
+		append(std::string(offset - size_, '\0'));
+
+	std::size_t written = 0;
+
+	while (written < data.size())
+	{
+		std::size_t pos = offset + written;
+		if (pos >= size_)
+		{
+			append(data.substr(written));
+			break;
+		}
+
+		std::string& chunk = writable_chunk(pos / chunk_size);
+		std::size_t at = pos % chunk_size;
+		std::size_t n = std::min(chunk.size() - at, data.size() - written);
+
+		chunk.replace(at, n, data.substr(written, n));
+		written += n;
+	}
+
+	return data.size();
+}
+
+std::string_view FileContent::view(std::size_t offset, std::size_t bytes) const
+{
+	if (offset >= size_)
+		return {};
+
+	if (owner_)
+		return external_.substr(offset, bytes);
+
+	const std::string& chunk = *chunks_[offset / chunk_size];
+	return std::string_view(chunk).substr(offset % chunk_size, bytes);
+}
+
+const std::string* FileContent::contiguous() const
+{
+	static const std::string empty_content{};
+
+	if (owner_)
+		return nullptr;
+
+	if (chunks_.empty())
+		return &empty_content;
+
+	if (chunks_.size() == 1)
+		return chunks_.front().get();
+
+	return nullptr;
+}
+
+std::optional<std::string_view> FileContent::contiguous_view() const
+{
+	if (owner_)
+		return external_;
+
+	if (const std::string* whole = contiguous())
+		return std::string_view(*whole);
+
+	return std::nullopt;
+}
+
+std::string FileContent::flatten() const
+{
+	if (owner_)
+		return std::string(external_);
+
+	std::string out{};
+	out.reserve(size_);
+
+	for (const auto& chunk : chunks_)
+		out.append(*chunk);
+
+	return out;
+}
+
+std::string& FileContent::writable_chunk(std::size_t idx)
+{
+	std::shared_ptr<std::string>& chunk = chunks_[idx];
+
+	if (chunk.use_count() > 1)
+		chunk = std::make_shared<std::string>(*chunk);
+
+	return *chunk;
+}
+
+void FileContent::internalise()
+{
+	/* Keep the owner alive until the bytes are copied. */
+	std::shared_ptr<const void> owner = std::move(owner_);
+	std::string_view data = std::exchange(external_, {});
+
+	size_ = 0;
+	append(data);
+}
@@ -1,5 +1,6 @@
 #include "filesystem.h"
 #include "session.h"
+#include "mapped_file.h"
 
 #include <ranges>
 #include <algorithm>
@@ -7,16 +8,59 @@
 #include <print>
 #include <iostream>
 #include <cassert>
+#include <fstream>
+#include <cstring>
+#include <utility>
 
 #include "proto/files.pb.h"
 
 #include <iso646.h>
 
+/* --- File System Image --- */
+
+namespace
+{
+	constexpr char fs_image_magic[8] = {'D', 'B', 'C', 'F', 'S', 'I', 'M', 'G'};
+	constexpr uint32_t fs_image_version = 1;
+
+	/* Followed by the records, then all names, then all file contents. */
+	struct FsImageHeader
+	{
+		char magic[8]{};
+		uint32_t version{0};
+		uint32_t num_records{0};
+		uint64_t names_offset{0};
+		uint64_t data_offset{0};
+		uint64_t total_size{0};
+	};
+
+	/* One file, in pre-order, so that a parent's record always comes before its children's. */
+	struct FsImageRecord
+	{
+		FileMeta meta{};
+		uint32_t parent{0};			// Index of the parent's record plus one, or 0 for the root.
+		uint32_t name_size{0};
+		uint64_t name_offset{0};	// From the start of the names.
+		uint64_t data_offset{0};	// From the start of the contents.
+		uint64_t data_size{0};
+	};
+
+	static_assert(std::is_trivially_copyable_v<FsImageHeader>);
+	static_assert(std::is_trivially_copyable_v<FsImageRecord>);
+}
+
 /* --- File System --- */
 
 FileSystem::FileSystem()
 { 
-	metadata_[get_root()] = {
+	inodes_.push_back(std::make_shared<TablePage<Inode>>());
+	entries_.push_back(std::make_shared<TablePage<InodeEntry>>());
+	num_slots_ = root_ + 1;
+
+	Inode& root = writable_inode(root_);
+	root.parent = static_cast<InodeLink>(root_);
+
+	root.meta = {
 		.owner_uid = 0,
 		.owner_gid = 0,
 		.perm_owner = FilePermissionTriad::All,
@@ -26,9 +70,34 @@ FileSystem::FileSystem()
 	};
 }
 
+void FileSystem::freeze()
+{
+	for (std::size_t fid = root_; fid < num_slots_; ++fid)
+	{
+		if (const Inode* node = get_node(static_cast<NodeIdx>(fid)); node && node->file)
+			node->file->freeze();
+	}
+
+	frozen_ = true;
+}
+
+void FileSystem::use_base(const FileSystem& base)
+{
+	assert(base.frozen_);
+	assert(open_files_.empty());
+
+	inodes_ = base.inodes_;
+	entries_ = base.entries_;
+	num_slots_ = base.num_slots_;
+	free_head_ = base.free_head_;
+	++dentry_epoch_;
+
+	clear_changes();
+}
+
 bool FileSystem::is_file(NodeIdx fid) const
 {
-	return fid == get_root() || files_.contains(fid);
+	return get_node(fid) != nullptr;
 }
 
 bool FileSystem::is_file(const FilePath& path) const
@@ -38,11 +107,8 @@ bool FileSystem::is_file(const FilePath& path) const
 
 bool FileSystem::is_dir(NodeIdx fid) const
 {
-	if (fid == get_root())
-		return true;
-
-	if (auto it = metadata_.find(fid); it != metadata_.end())
-		return has_flag<ExtraFileFlags, uint8_t>(it->second.extra, ExtraFileFlags::Directory);
+	if (const Inode* node = get_node(fid))
+		return has_flag<ExtraFileFlags, uint8_t>(node->meta.extra, ExtraFileFlags::Directory);
 
 	return false;
 }
@@ -54,8 +120,8 @@ bool FileSystem::is_dir(const FilePath& path) const
 
 bool FileSystem::is_directory_root(NodeIdx fid) const
 {
-	if (auto it = roots_.find(fid); it != roots_.end())
-		return it->second == fid; // If the root is itself, it counts as a root.
+	if (const Inode* node = get_node(fid))
+		return node->parent == fid; // If the root is itself, it counts as a root.
 	
 	return true;
 }
@@ -65,27 +131,39 @@ bool FileSystem::is_empty(NodeIdx fid) const
 	if (!is_dir(fid))
 		return true;
 
-	std::vector<NodeIdx> files = get_files(fid);
-	return files.empty();
+	return get_node(fid)->first_child == 0;
 }
 
 std::string_view FileSystem::get_filename(NodeIdx fid) const
 {
-	if (auto it = fid_to_path_.find(fid); it != fid_to_path_.end())
-		return it->second.get_name();
+	if (get_node(fid))
+		return entry(fid).name;
 
 	return {};
 }
 
 FilePath FileSystem::get_path(NodeIdx fid) const
 {
-	if (fid == get_root())
-		return {"/"};
+	if (!get_node(fid))
+		return {};
 
-	if (auto it = fid_to_path_.find(fid); it != fid_to_path_.end())
-		return it->second;
+	/* Measure first, then fill in the names from the leaf backwards. */
+	std::size_t length = 0;
+	for (NodeIdx it = fid; it != root_; it = inode(it).parent)
+		length += entry(it).name.size() + 1;
 
-	return {};
+	std::string out(length, '/');
+	std::size_t end = length;
+
+	for (NodeIdx it = fid; it != root_; it = inode(it).parent)
+	{
+		const std::string& name = entry(it).name;
+		end -= name.size();
+		name.copy(out.data() + end, name.size());
+		--end;
+	}
+
+	return FilePath{std::move(out)};
 }
 
 NodeIdx FileSystem::get_fid(const FilePath& path) const
@@ -93,22 +171,73 @@ NodeIdx FileSystem::get_fid(const FilePath& path) const
 	if (path.is_root_or_empty())
 		return get_root();
 
-	if (auto it = path_to_fid_.find(path); it != path_to_fid_.end())
+	if (path.is_relative())
+		return 0;
+
+	std::string_view key = path.get_view();
+	DentryCacheSlot& slot = dentry_cache_[std::hash<std::string_view>{}(key) % dentry_cache_size];
+
+	if (slot.epoch == dentry_epoch_ && slot.path == key)
+		return slot.fid;
+
+	NodeIdx fid = resolve_path(key);
+
+	/* Only hits are cached; a miss may become a hit with any new file, which doesn't move the epoch. */
+	if (fid != 0)
+	{
+		slot.path.assign(key);
+		slot.fid = fid;
+		slot.epoch = dentry_epoch_;
+	}
+
+	return fid;
+}
+
+NodeIdx FileSystem::get_child(NodeIdx dir, std::string_view name) const
+{
+	if (!get_node(dir) || !entry(dir).children)
+		return 0;
+
+	const DirEntryMap& children = *entry(dir).children;
+	if (auto it = children.find(name); it != children.end())
 		return it->second;
 
 	return 0;
 }
 
+NodeIdx FileSystem::resolve_path(std::string_view path) const
+{
+	NodeIdx current = root_;
+	std::size_t pos = 0;
+
+	while (current != 0 && pos < path.size())
+	{
+		std::size_t next = path.find('/', pos);
+		if (next == std::string_view::npos)
+			next = path.size();
+
+		if (next > pos)
+			current = get_child(current, path.substr(pos, next - pos));
+
+		pos = next + 1;
+	}
+
+	return current;
+}
+
 std::size_t FileSystem::get_links(NodeIdx fid)
 {
-	return mappings_.count(fid);
+	if (const Inode* node = get_node(fid))
+		return node->num_children;
+
+	return 0;
 }
 
 std::size_t FileSystem::get_bytes(NodeIdx fid)
 {
-	if (auto it = files_.find(fid); it != files_.end())
+	if (const Inode* node = get_node(fid); node && node->file)
 	{
-		return it->second->size();
+		return node->file->size();
 	}
 
 	return 0;
@@ -118,12 +247,12 @@ std::string FileSystem::get_flags(NodeIdx fid)
 {
 	std::string out(10, '-');
 
-	if (auto it = metadata_.find(fid); it != metadata_.end())
+	if (auto* node = get_node(fid))
 	{
-		const FilePermissionTriad& o = it->second.perm_owner;
-		const FilePermissionTriad& g = it->second.perm_group;
-		const FilePermissionTriad& u = it->second.perm_users;
-		const ExtraFileFlags& e = it->second.extra;
+		const FilePermissionTriad& o = node->meta.perm_owner;
+		const FilePermissionTriad& g = node->meta.perm_group;
+		const FilePermissionTriad& u = node->meta.perm_users;
+		const ExtraFileFlags& e = node->meta.extra;
 
 		bool dir = has_flag<ExtraFileFlags, uint8_t>(e, ExtraFileFlags::Directory);
 		out[0] = dir ? 'd' : '-';
@@ -150,9 +279,9 @@ std::string FileSystem::get_flags(NodeIdx fid)
 
 std::pair<int32_t, int32_t> FileSystem::get_owner(NodeIdx fid)
 {
-	if (auto it = metadata_.find(fid); it != metadata_.end())
+	if (auto* node = get_node(fid))
 	{
-		return std::make_pair(it->second.owner_uid, it->second.owner_gid);
+		return std::make_pair(node->meta.owner_uid, node->meta.owner_gid);
 	}
 	return std::make_pair(0, 0);
 }
@@ -160,9 +289,9 @@ std::pair<int32_t, int32_t> FileSystem::get_owner(NodeIdx fid)
 std::string FileSystem::get_mdate(NodeIdx fid)
 {
 	
-	if (auto it = metadata_.find(fid); it != metadata_.end())
+	if (auto* node = get_node(fid))
 	{
-		std::chrono::system_clock::time_point tp{std::chrono::seconds{it->second.modified}};
+		std::chrono::system_clock::time_point tp{std::chrono::seconds{node->meta.modified}};
 		return std::format("{:%Y-%m-%d %X}", tp);
 	}
 
@@ -171,41 +300,56 @@ std::string FileSystem::get_mdate(NodeIdx fid)
 
 uint64_t FileSystem::get_last_modified(NodeIdx fid)
 {
-	if (auto it = metadata_.find(fid); it != metadata_.end())
-		return it->second.modified;
+	if (auto* node = get_node(fid))
+		return node->meta.modified;
 		
 	return 0;
 }
 
 FileMeta* FileSystem::get_metadata(NodeIdx fid)
 {
-	if (auto it = metadata_.find(fid); it != metadata_.end())
-		return &it->second;
+	if (auto* node = get_writable_node(fid))
+		return &node->meta;
 		
 	return nullptr;
 }
 
+const FileMeta* FileSystem::get_metadata(NodeIdx fid) const
+{
+	if (const Inode* node = get_node(fid))
+		return &node->meta;
+
+	return nullptr;
+}
+
 std::vector<NodeIdx> FileSystem::get_files(NodeIdx dir, bool recurse) const
 {
 	if (!is_dir(dir))
 		return {};
 
 	std::vector<NodeIdx> v{};
+	collect_files(dir, recurse, v);
+	return v;
+}
+
+void FileSystem::collect_files(NodeIdx dir, bool recurse, std::vector<NodeIdx>& out) const
+{
+	/* Children of a directory come first, then the contents of each child in turn. */
+	const std::size_t first = out.size();
+
+	for (InodeLink child = inode(dir).first_child; child != 0; child = inode(child).next_sibling)
+		out.push_back(child);
+
+	if (!recurse)
+		return;
 
-	auto range = mappings_.equal_range(dir);
-	std::transform(range.first, range.second, std::back_inserter(v), [](std::pair<NodeIdx, NodeIdx> element){ return element.second; });
+	const std::size_t last = out.size();
 
-	if (recurse)
+	for (std::size_t i = first; i < last; ++i)
 	{
-		std::vector<NodeIdx> v2{};
-		for (NodeIdx child : v)
-		{
-			v2.append_range(get_files(child, true));
-		}
-		v.append_range(v2);
+		if (inode(out[i]).first_child != 0)
+			collect_files(out[i], true, out);
 	}
-
-	return v;
 }
 
 std::vector<NodeIdx> FileSystem::get_files(const FilePath& path, bool recurse) const
@@ -227,8 +371,8 @@ std::vector<FilePath> FileSystem::get_paths(const FilePath& path, bool recurse)
 
 NodeIdx FileSystem::get_parent_folder(NodeIdx fid) const
 {
-	if (auto it = roots_.find(fid); it != roots_.end())
-		return it->second;
+	if (const Inode* node = get_node(fid))
+		return node->parent;
 
 	return fid;
 }
@@ -283,16 +427,18 @@ NodeIdx FileSystem::create_ensure_path(const FilePath& path, const CreateFilePar
 
 bool FileSystem::remove_file(NodeIdx fid, FileRemoverFn&& func)
 {
-	FilePath path = get_path(fid);
-	return remove_file(path, std::forward<FileRemoverFn>(func));
+	return remove_tree(fid, get_path(fid), func);
 }
 
 bool FileSystem::remove_file(const FilePath& path, FileRemoverFn&& func)
 {
-	NodeIdx fid = get_fid(path);
+	return remove_tree(get_fid(path), path, func);
+}
 
+bool FileSystem::remove_tree(NodeIdx fid, const FilePath& path, FileRemoverFn& func)
+{
 	/* If this is the root directory, ensure we can operate on it. */
-	if (path == "/" && !func(*this, path, std::error_condition{EPERM, std::generic_category()}))
+	if (fid == root_ && !func(*this, path, std::error_condition{EPERM, std::generic_category()}))
 	{
 		return false;
 	}
@@ -311,54 +457,47 @@ bool FileSystem::remove_file(const FilePath& path, FileRemoverFn&& func)
 	}
 
 	/* If we get here, the callback must have given green light for recursion.
-	Remove all children. */
-	for (NodeIdx child : get_files(fid))
+	The contents are removed bottom-up; each directory below is asked about as the walk reaches it,
+	and once the callback refuses one, the rest of the walk is skipped without asking again. */
+	bool refused = false;
+
+	auto may_enter = [this, &func, &refused](NodeIdx child)
 	{
-		if (!remove_file(child, std::forward<FileRemoverFn>(func)))
-		{
+		if (refused)
 			return false;
-		}
-	}
 
-	/* Even if callback requests resume, fail if not empty after recursion. */
-	if (!is_empty(fid))
-	{
-		func(*this, path, std::error_condition{ENOTEMPTY, std::generic_category()});
+		if (is_empty(child) || func(*this, get_path(child), std::error_condition{ENOTEMPTY, std::generic_category()}))
+			return true;
+
+		refused = true;
 		return false;
-	}
+	};
 
-	/* Get the root of this file and erase the file from its parent mapping,
-	if such a root exists. */
-	if (auto parent = roots_.find(fid); parent != roots_.end())
+	for (NodeIdx child : walk(fid, WalkOrder::PostOrder, may_enter))
 	{
-		auto range = mappings_.equal_range(parent->second);
-		auto it = range.first;
-		
-		for (; it != range.second; )
+		if (refused)
+			return false;
+
+		FilePath child_path = get_path(child);
+		mark_removed(child);
+		unlink_node(child);
+
+		if (!func(*this, child_path, {}))
 		{
-			if (it->second == fid)
-			{
-				it = mappings_.erase(it);
-			}
-			else ++it;
+			return false;
 		}
-
-		/* Actually remove this file from the roots map. */
-		roots_.erase(parent);
 	}
 
-	/* Remove the file from the path-fid/fid-path mappings. */
-	if (auto it = fid_to_path_.find(fid); it != fid_to_path_.end())
+	/* Even if callback requests resume, fail if not empty after recursion. */
+	if (refused || !is_empty(fid))
 	{
-		path_to_fid_.erase(it->second);
-		fid_to_path_.erase(it);
+		return false;
 	}
 
-	/* Remove the file itself. */
-	files_.erase(fid);
+	mark_removed(fid);
+	unlink_node(fid);
 
 	return func(*this, path, {});
-
 }
 
 std::error_condition FileSystem::remove_file(NodeIdx fid, bool recurse)
@@ -366,66 +505,75 @@ std::error_condition FileSystem::remove_file(NodeIdx fid, bool recurse)
 	if (!is_file(fid))
 		return {ENOENT, std::generic_category()};
 
-	if (is_empty(fid))
-	{
-		/* Get the root of this file and erase the file from its parent mapping,
-		if such a root exists. */
-		if (auto parent = roots_.find(fid); parent != roots_.end())
-		{
-			auto range = mappings_.equal_range(parent->second);
-			auto it = range.first;
-			
-			for (; it != range.second; )
-			{
-				if (it->second == fid)
-				{
-					it = mappings_.erase(it);
-				}
-				else ++it;
-			}
+	if (!is_empty(fid) && !recurse)
+		return {ENOTEMPTY, std::generic_category()};
 
-			/* Actually remove this file from the roots map. */
-			roots_.erase(parent);
-		}
+	/* Post-order, so each file is empty by the time it is unlinked. */
+	/* One tombstone covers everything below. */
+	mark_removed(fid);
 
-		/* Remove the file from the path-fid/fid-path mappings. */
-		if (auto it = fid_to_path_.find(fid); it != fid_to_path_.end())
-		{
-			path_to_fid_.erase(it->second);
-			fid_to_path_.erase(it);
-		}
+	for (NodeIdx child : walk(fid, WalkOrder::PostOrder))
+		unlink_node(child);
 
-		/* Remove the file itself. */
-		files_.erase(fid);
+	unlink_node(fid);
+	return {};
+}
 
-		return {};
-	}
-	else if (recurse)
+std::error_condition FileSystem::remove_file(const FilePath& path, bool recurse)
+{
+	NodeIdx fid = get_fid(path);
+	return remove_file(fid, recurse);
+}
+
+std::error_condition FileSystem::move_file(NodeIdx fid, const FilePath& to)
+{
+	if (!is_file(fid))
+		return {ENOENT, std::generic_category()};
+
+	if (fid == root_)
+		return {EBUSY, std::generic_category()};
+
+	NodeIdx parent_fid = get_fid(to.get_parent_path());
+	if (parent_fid == 0)
+		return {ENOENT, std::generic_category()};
+
+	if (get_fid(to) != 0)
+		return {EEXIST, std::generic_category()};
+
+	/* A directory can't be moved into itself, or anywhere below itself. */
+	for (NodeIdx it = parent_fid; it != root_; it = inode(it).parent)
 	{
-		for (NodeIdx child : get_files(fid))
-		{
-			if (auto err = remove_file(child, true); err.value() > 0)
-				return err;
-		}
-		return remove_file(fid, false);
+		if (it == fid)
+			return {EINVAL, std::generic_category()};
 	}
 
-	return {ENOTEMPTY, std::generic_category()};
+	/* Descendants only know their own names, so they come along without being touched. */
+	mark_removed(fid);
+	detach_child(fid);
+	writable_entry(fid).name = to.get_name();
+	attach_child(fid, parent_fid);
+	mark_changed(fid, InodeChange::Subtree);
+
+	++dentry_epoch_;
+	return {};
 }
 
-std::error_condition FileSystem::remove_file(const FilePath& path, bool recurse)
+std::error_condition FileSystem::move_file(const FilePath& from, const FilePath& to)
 {
-	NodeIdx fid = get_fid(path);
-	return remove_file(fid, recurse);
+	return move_file(get_fid(from), to);
 }
 
 FileOpResult FileSystem::get_file(NodeIdx fid, FileAccessFlags flags)
 {
 	if (is_dir(fid) && has_flag<FileAccessFlags>(flags, FileAccessFlags::Write))
 		return std::make_tuple(fid, nullptr, std::error_condition{EINVAL, std::generic_category()});
+
+	/* A file shared with a base image is copied before it is handed out for writing. */
+	if (has_flag<FileAccessFlags>(flags, FileAccessFlags::Write))
+		find(fid);
 	
-	if (auto it = files_.find(fid); it != files_.end())
-		return std::make_tuple(fid, it->second, std::error_condition{});
+	if (const Inode* node = get_node(fid); node && node->file)
+		return std::make_tuple(fid, node->file, std::error_condition{});
 
 	return std::make_tuple(0, nullptr, std::error_condition{ENOENT, std::generic_category()});
 }
@@ -440,8 +588,24 @@ FileOpResult FileSystem::get_file(const FilePath& path, FileAccessFlags flags)
 
 File* FileSystem::find(NodeIdx fid)
 {
-	if (auto it = files_.find(fid); it != files_.end())
-		return it->second.get();
+	const Inode* node = get_node(fid);
+	if (!node || !node->file)
+		return nullptr;
+
+	if (node->file->is_frozen())
+	{
+		std::shared_ptr<File> copy = node->file->clone();
+		get_writable_node(fid)->file = std::move(copy);
+	}
+
+	mark_changed(fid);
+	return inode(fid).file.get();
+}
+
+const File* FileSystem::find(NodeIdx fid) const
+{
+	if (const Inode* node = get_node(fid))
+		return node->file.get();
 
 	return nullptr;
 }
@@ -463,9 +627,9 @@ bool FileSystem::has_flag(const FilePermissionTriad& base, FilePermissionTriad t
 
 bool FileSystem::file_set_flag(NodeIdx fid, FilePermissionCategory cat, FilePermissionTriad set_flags)
 {
-	if (auto it = metadata_.find(fid); it != metadata_.end())
+	if (auto* node = get_writable_node(fid))
 	{
-		file_set_flag(it->second, cat, set_flags);
+		file_set_flag(node->meta, cat, set_flags);
 		return true;
 	}
 	return false;
@@ -473,9 +637,9 @@ bool FileSystem::file_set_flag(NodeIdx fid, FilePermissionCategory cat, FilePerm
 
 bool FileSystem::file_clear_flag(NodeIdx fid, FilePermissionCategory cat, FilePermissionTriad clear_flags)
 {
-	if (auto it = metadata_.find(fid); it != metadata_.end())
+	if (auto* node = get_writable_node(fid))
 	{
-		file_clear_flag(it->second, cat, clear_flags);
+		file_clear_flag(node->meta, cat, clear_flags);
 		return true;
 	}
 	return false;
@@ -483,9 +647,9 @@ bool FileSystem::file_clear_flag(NodeIdx fid, FilePermissionCategory cat, FilePe
 
 bool FileSystem::file_has_flag(NodeIdx fid, FilePermissionCategory cat, FilePermissionTriad test_flags) const
 {
-	if (auto it = metadata_.find(fid); it != metadata_.end())
+	if (auto* node = get_node(fid))
 	{
-		file_has_flag(it->second, cat, test_flags);
+		file_has_flag(node->meta, cat, test_flags);
 		return true;
 	}
 	return false;
@@ -524,15 +688,15 @@ bool FileSystem::file_has_flag(const FileMeta& meta, FilePermissionCategory cat,
 
 bool FileSystem::file_set_directory_flag(NodeIdx fid, bool new_is_dir)
 {
-	if (auto it = metadata_.find(fid); it != metadata_.end())
+	if (auto* node = get_writable_node(fid))
 	{
 		if (new_is_dir) 
 		{ 
-			set_flag<ExtraFileFlags, uint8_t>(it->second.extra, ExtraFileFlags::Directory); 
+			set_flag<ExtraFileFlags, uint8_t>(node->meta.extra, ExtraFileFlags::Directory); 
 		}
 		else 
 		{ 
-			clear_flag<ExtraFileFlags, uint8_t>(it->second.extra, ExtraFileFlags::Directory); 
+			clear_flag<ExtraFileFlags, uint8_t>(node->meta.extra, ExtraFileFlags::Directory); 
 		}
 		return true;
 	}
@@ -541,10 +705,10 @@ bool FileSystem::file_set_directory_flag(NodeIdx fid, bool new_is_dir)
 
 bool FileSystem::file_set_modified_now(NodeIdx fid)
 {
-	if (auto it = metadata_.find(fid); it != metadata_.end())
+	if (auto* node = get_writable_node(fid))
 	{
 		auto now = std::chrono::current_zone()->to_local(std::chrono::system_clock::now());
-		it->second.modified = std::chrono::duration_cast<std::chrono::seconds>(now.time_since_epoch()).count();
+		node->meta.modified = std::chrono::duration_cast<std::chrono::seconds>(now.time_since_epoch()).count();
 		return true;
 	}
 	return false;
@@ -552,11 +716,11 @@ bool FileSystem::file_set_modified_now(NodeIdx fid)
 
 bool FileSystem::file_set_permissions(NodeIdx fid, FilePermissionTriad owner, FilePermissionTriad group, FilePermissionTriad users)
 {
-	if (auto it = metadata_.find(fid); it != metadata_.end())
+	if (auto* node = get_writable_node(fid))
 	{
-		it->second.perm_owner = owner;
-		it->second.perm_group = group;
-		it->second.perm_users = users;
+		node->meta.perm_owner = owner;
+		node->meta.perm_group = group;
+		node->meta.perm_users = users;
 		return true;
 	}
 	return false;
@@ -572,9 +736,9 @@ bool FileSystem::file_set_permissions(NodeIdx fid, int32_t owner, int32_t group,
 
 bool FileSystem::check_permission(const SessionData& session, NodeIdx fid, FileAccessFlags mode)
 {
-	if (auto it = metadata_.find(fid); it != metadata_.end())
+	if (auto* node = get_node(fid))
 	{
-		FileMeta& meta = it->second;
+		const FileMeta& meta = node->meta;
 
 		bool group_match = (session.gid == meta.owner_gid || session.groups.contains(meta.owner_gid));
 		bool owner_match = (session.uid == meta.owner_uid);
@@ -666,12 +830,16 @@ std::expected<size_t, std::error_condition> FileSystem::write(OpenFileHandle h,
 	if (auto it = open_files_.find(h); it != open_files_.end())
 	{
 		OpenFileTableEntry& entry = it->second;
-		File* file = find(entry.node);
-		assert(file);
 
+		/* Checked first; finding the file for writing copies a shared one and marks it changed. */
 		if (not has_flag<FileAccessFlags>(entry.flags, FileAccessFlags::Write))
 			return std::unexpected(std::error_condition{EPERM, std::generic_category()});
 
+		File* file = find(entry.node);
+		assert(file);
+
+		std::size_t written = data.size();
+
 		if (has_flag<FileAccessFlags>(entry.flags, FileAccessFlags::Append))
 		{
 			file->append(std::move(data));
@@ -681,9 +849,10 @@ std::expected<size_t, std::error_condition> FileSystem::write(OpenFileHandle h,
 			file->write(std::move(data));
 		}
 
+		entry.offset = file->size();
 		file_set_modified_now(entry.node);
 
-		return data.size();
+		return written;
 	}
 
 	return std::unexpected(std::error_condition{EFAULT, std::generic_category()});
@@ -694,27 +863,69 @@ std::expected<std::string_view, std::error_condition> FileSystem::read(OpenFileH
 	if (auto it = open_files_.find(h); it != open_files_.end())
 	{
 		OpenFileTableEntry& entry = it->second;
-		File* file = find(entry.node);
+		const File* file = std::as_const(*this).find(entry.node);
 		assert(file);
 
 		if (not has_flag<FileAccessFlags>(entry.flags, FileAccessFlags::Read))
 			return std::unexpected(std::error_condition{EPERM, std::generic_category()});
 
-		// TODO: Actually do something with the 'bytes' parameter.
-		return file->get_view();
+		if (bytes == 0)
+			return file->get_view();
+
+		std::string_view out = file->view(entry.offset, bytes);
+		entry.offset += out.size();
+		return out;
 	}
 
 	return std::unexpected(std::error_condition{EFAULT, std::generic_category()});
 }
 
-std::expected<File*, std::error_condition> FileSystem::get(OpenFileHandle h)
+std::expected<std::string, std::error_condition> FileSystem::pread(OpenFileHandle h, size_t offset, size_t bytes)
 {
 	if (auto it = open_files_.find(h); it != open_files_.end())
 	{
 		OpenFileTableEntry& entry = it->second;
+		const File* file = std::as_const(*this).find(entry.node);
+		assert(file);
+
+		if (not has_flag<FileAccessFlags>(entry.flags, FileAccessFlags::Read))
+			return std::unexpected(std::error_condition{EPERM, std::generic_category()});
+
+		return file->pread(offset, bytes);
+	}
+
+	return std::unexpected(std::error_condition{EFAULT, std::generic_category()});
+}
+
+std::expected<size_t, std::error_condition> FileSystem::pwrite(OpenFileHandle h, size_t offset, std::string_view data)
+{
+	if (auto it = open_files_.find(h); it != open_files_.end())
+	{
+		OpenFileTableEntry& entry = it->second;
+
+		if (not has_flag<FileAccessFlags>(entry.flags, FileAccessFlags::Write))
+			return std::unexpected(std::error_condition{EPERM, std::generic_category()});
+
 		File* file = find(entry.node);
 		assert(file);
 
+		std::size_t written = file->pwrite(offset, data);
+		file_set_modified_now(entry.node);
+
+		return written;
+	}
+
+	return std::unexpected(std::error_condition{EFAULT, std::generic_category()});
+}
+
+std::expected<const File*, std::error_condition> FileSystem::get(OpenFileHandle h) const
+{
+	if (auto it = open_files_.find(h); it != open_files_.end())
+	{
+		const OpenFileTableEntry& entry = it->second;
+		const File* file = find(entry.node);
+		assert(file);
+
 		if (not has_flag<FileAccessFlags>(entry.flags, FileAccessFlags::Execute))
 			return std::unexpected(std::error_condition{EPERM, std::generic_category()});
 
@@ -726,31 +937,91 @@ std::expected<File*, std::error_condition> FileSystem::get(OpenFileHandle h)
 
 bool FileSystem::serialize(world::FileSystem* to) const
 {
-	for (auto&& [h, file] : files_)
-	{
-		const FileMeta& meta = metadata_.at(h);
-		const FilePath& path = fid_to_path_.at(h);
+	/* Directories come before their contents, so loading never has to create a missing parent. */
+	for (NodeIdx fid : walk(root_))
+		serialize_file(fid, to);
 
+	return true;
+}
+
+bool FileSystem::serialize_changes(world::FileSystem* to)
+{
+	to->set_incremental(true);
+
+	/* Removals go first, so that a path removed and then used again ends up as the new file. */
+	for (std::string& path : tombstones_)
+	{
 		world::File* arr = to->add_files();
-		arr->set_content(file->get_string());
-		arr->set_path(path.get_string());
+		arr->set_path(std::move(path));
+		arr->set_removed(true);
+	}
 
-		arr->set_modified(meta.modified); 								//uint64_t modified{0};
-		arr->set_owner_uid(meta.owner_uid); 							//int32_t owner_uid{0};
-		arr->set_owner_gid(meta.owner_gid); 							//int32_t owner_gid{0};
-		arr->set_perm_owner(static_cast<uint32_t>(meta.perm_owner)); 	//FilePermissionTriad perm_owner{7};
-		arr->set_perm_group(static_cast<uint32_t>(meta.perm_group)); 	//FilePermissionTriad perm_group{0};
-		arr->set_perm_users(static_cast<uint32_t>(meta.perm_users)); 	//FilePermissionTriad perm_users{0};
-		arr->set_extra(static_cast<uint32_t>(meta.extra)); 				//ExtraFileFlags extra{};
+	for (NodeIdx fid : changed_)
+	{
+		InodeChange change = change_flags_[fid];
+		if (change == InodeChange::None || !get_node(fid))
+			continue;
+
+		change_flags_[fid] = InodeChange::None;
+		serialize_file(fid, to);
+
+		if (!has_flag<InodeChange, uint8_t>(change, InodeChange::Subtree))
+			continue;
+
+		for (NodeIdx child : walk(fid))
+		{
+			if (static_cast<std::size_t>(child) < change_flags_.size())
+				change_flags_[child] = InodeChange::None;
+
+			serialize_file(child, to);
+		}
 	}
 
+	clear_changes();
 	return true;
 }
 
+void FileSystem::clear_changes()
+{
+	for (NodeIdx fid : changed_)
+		change_flags_[fid] = InodeChange::None;
+
+	changed_.clear();
+	tombstones_.clear();
+}
+
+void FileSystem::serialize_file(NodeIdx fid, world::FileSystem* to) const
+{
+	const Inode& node = inode(fid);
+	if (!node.file)
+		return;
+
+	const std::shared_ptr<File>& file = node.file;
+	const FileMeta& meta = node.meta;
+
+	world::File* arr = to->add_files();
+	arr->set_content(file->get_content().flatten());
+	arr->set_path(get_path(fid).get_string());
+
+	arr->set_modified(meta.modified); 								//uint64_t modified{0};
+	arr->set_owner_uid(meta.owner_uid); 							//int32_t owner_uid{0};
+	arr->set_owner_gid(meta.owner_gid); 							//int32_t owner_gid{0};
+	arr->set_perm_owner(static_cast<uint32_t>(meta.perm_owner)); 	//FilePermissionTriad perm_owner{7};
+	arr->set_perm_group(static_cast<uint32_t>(meta.perm_group)); 	//FilePermissionTriad perm_group{0};
+	arr->set_perm_users(static_cast<uint32_t>(meta.perm_users)); 	//FilePermissionTriad perm_users{0};
+	arr->set_extra(static_cast<uint32_t>(meta.extra)); 				//ExtraFileFlags extra{};
+}
+
 bool FileSystem::deserialize(const world::FileSystem& from)
 {
 	for (auto&& file : from.files())
 	{
+		if (file.removed())
+		{
+			remove_file(FilePath{file.path()}, true);
+			continue;
+		}
+
 		FileMeta ar_meta
 		{
 			.modified = file.modified(),
@@ -763,12 +1034,13 @@ bool FileSystem::deserialize(const world::FileSystem& from)
 		};
 
 		FilePath path{file.path()};
-		if (auto it = path_to_fid_.find(path); it != path_to_fid_.end())
+		if (NodeIdx fid = get_fid(path))
 		{
-			metadata_[it->second] = ar_meta;
-			File* f = find(it->second);
+			get_writable_node(fid)->meta = ar_meta;
+			File* f = find(fid);
 			assert(f);
 			f->write(file.content());
+			f->intern();
 		}
 		else
 		{
@@ -786,6 +1058,310 @@ bool FileSystem::deserialize(const world::FileSystem& from)
 	return true;
 }
 
+std::error_condition FileSystem::save_image(const std::filesystem::path& path) const
+{
+	FsImageHeader header{};
+	std::memcpy(header.magic, fs_image_magic, sizeof(header.magic));
+	header.version = fs_image_version;
+
+	std::vector<FsImageRecord> records{};
+	std::vector<uint32_t> record_of(num_slots_, 0);
+	std::string names{};
+	uint64_t data_size = 0;
+
+	for (NodeIdx fid : walk(root_))
+	{
+		const Inode& node = inode(fid);
+		const std::string& name = entry(fid).name;
+
+		FsImageRecord& record = records.emplace_back();
+		record.meta = node.meta;
+		record.parent = (node.parent == root_) ? 0 : record_of[node.parent];
+		record.name_size = static_cast<uint32_t>(name.size());
+		record.name_offset = names.size();
+		record.data_offset = data_size;
+		record.data_size = node.file ? node.file->size() : 0;
+
+		record_of[fid] = static_cast<uint32_t>(records.size());
+		names += name;
+		data_size += record.data_size;
+	}
+
+	header.num_records = static_cast<uint32_t>(records.size());
+	header.names_offset = sizeof(FsImageHeader) + records.size() * sizeof(FsImageRecord);
+	header.data_offset = header.names_offset + names.size();
+	header.total_size = header.data_offset + data_size;
+
+	/* Written aside and moved into place, so a failed save never leaves a partial image at the path.
+	On Windows the move fails if an image at the path is still mapped; callers that replace mapped images
+	should save each time under a new name instead (see FileGenerations). */
+	std::filesystem::path temp_path = path;
+	temp_path += ".tmp";
+
+	/* Scoped file */
+	{
+		std::ofstream out(temp_path, std::ios::binary | std::ios::trunc);
+		if (!out)
+			return {EIO, std::generic_category()};
+
+		out.write(reinterpret_cast<const char*>(&header), sizeof(header));
+		out.write(reinterpret_cast<const char*>(records.data()), static_cast<std::streamsize>(records.size() * sizeof(FsImageRecord)));
+		out.write(names.data(), static_cast<std::streamsize>(names.size()));
+
+		for (NodeIdx fid : walk(root_))
+		{
+			const std::shared_ptr<File>& file = inode(fid).file;
+			if (!file)
+				continue;
+
+			const FileContent& content = file->get_content();
+			for (std::size_t offset = 0; offset < content.size(); )
+			{
+				std::string_view piece = content.view(offset, content.size() - offset);
+				out.write(piece.data(), static_cast<std::streamsize>(piece.size()));
+				offset += piece.size();
+			}
+		}
+
+		if (!out)
+			return {EIO, std::generic_category()};
+	}
+
+	std::error_code ec{};
+	std::filesystem::rename(temp_path, path, ec);
+	if (ec)
+		return {EIO, std::generic_category()};
+
+	return {};
+}
+
+std::error_condition FileSystem::load_image(const std::filesystem::path& path)
+{
+	auto exp_map = MappedFile::open(path);
+	if (!exp_map)
+		return exp_map.error();
+
+	std::shared_ptr<const MappedFile> mapping = std::move(exp_map).value();
+	std::string_view image = mapping->view();
+
+	FsImageHeader header{};
+	if (image.size() < sizeof(header))
+		return {EINVAL, std::generic_category()};
+
+	std::memcpy(&header, image.data(), sizeof(header));
+
+	const uint64_t records_end = sizeof(FsImageHeader) + uint64_t{header.num_records} * sizeof(FsImageRecord);
+
+	if (std::memcmp(header.magic, fs_image_magic, sizeof(header.magic)) != 0
+		|| header.version != fs_image_version
+		|| header.total_size != image.size()
+		|| header.names_offset != records_end
+		|| header.data_offset < header.names_offset
+		|| header.data_offset > header.total_size)
+	{
+		return {EINVAL, std::generic_category()};
+	}
+
+	std::string_view names = image.substr(header.names_offset, header.data_offset - header.names_offset);
+	std::string_view data = image.substr(header.data_offset);
+
+	/* The fid each record ended up as, or 0 if it (or its parent) was rejected. */
+	std::vector<NodeIdx> fids(header.num_records, 0);
+
+	for (uint32_t i = 0; i < header.num_records; ++i)
+	{
+		FsImageRecord record{};
+		std::memcpy(&record, image.data() + sizeof(FsImageHeader) + i * sizeof(FsImageRecord), sizeof(record));
+
+		/* Checked so that a damaged image can't reach outside itself. */
+		if (record.parent > i
+			|| record.name_offset > names.size() || record.name_size > names.size() - record.name_offset
+			|| record.data_offset > data.size() || record.data_size > data.size() - record.data_offset)
+		{
+			continue;
+		}
+
+		NodeIdx parent_fid = (record.parent == 0) ? root_ : fids[record.parent - 1];
+		std::string_view name = names.substr(record.name_offset, record.name_size);
+
+		if (parent_fid == 0 || name.empty() || name.find('/') != std::string_view::npos)
+			continue;
+
+		NodeIdx fid = get_child(parent_fid, name);
+		File* file = nullptr;
+
+		if (fid != 0)
+		{
+			get_writable_node(fid)->meta = record.meta;
+			file = find(fid);
+		}
+		else
+		{
+			fid = alloc_node();
+			auto new_file = std::make_shared<File>(fid);
+			file = new_file.get();
+			link_node(fid, parent_fid, name, record.meta, std::move(new_file));
+		}
+
+		if (file)
+		{
+			FileContent content{};
+			content.assign_external(mapping, data.substr(record.data_offset, record.data_size));
+			file->set_content(std::move(content));
+		}
+
+		fids[i] = fid;
+	}
+
+	return {};
+}
+
+const Inode* FileSystem::get_node(NodeIdx fid) const
+{
+	if (fid <= 0 || fid >= static_cast<NodeIdx>(num_slots_) || inode(fid).parent == 0)
+		return nullptr;
+
+	return &inode(fid);
+}
+
+Inode* FileSystem::get_writable_node(NodeIdx fid)
+{
+	if (!get_node(fid))
+		return nullptr;
+
+	mark_changed(fid);
+	return &writable_inode(fid);
+}
+
+DirEntryMap& FileSystem::writable_children(NodeIdx dir)
+{
+	std::shared_ptr<DirEntryMap>& children = writable_entry(dir).children;
+	if (!children)
+		children = std::make_shared<DirEntryMap>();
+	else if (children.use_count() > 1)
+		children = std::make_shared<DirEntryMap>(*children);
+
+	return *children;
+}
+
+NodeIdx FileSystem::alloc_node()
+{
+	if (free_head_ != 0)
+	{
+		NodeIdx fid = free_head_;
+		Inode& node = writable_inode(fid);
+		free_head_ = node.next_sibling;
+		node.next_sibling = 0;
+		return fid;
+	}
+
+	if (num_slots_ == inodes_.size() * inode_page_size)
+	{
+		inodes_.push_back(std::make_shared<TablePage<Inode>>());
+		entries_.push_back(std::make_shared<TablePage<InodeEntry>>());
+	}
+
+	return static_cast<NodeIdx>(num_slots_++);
+}
+
+void FileSystem::link_node(NodeIdx fid, NodeIdx parent_fid, std::string_view name, const FileMeta& meta, std::shared_ptr<File> file)
+{
+	Inode& node = writable_inode(fid);
+	node.file = std::move(file);
+	node.meta = meta;
+	node.first_child = 0;
+	node.last_child = 0;
+	node.num_children = 0;
+
+	writable_entry(fid).name = name;
+	attach_child(fid, parent_fid);
+
+	mark_changed(fid, InodeChange::Created);
+}
+
+void FileSystem::unlink_node(NodeIdx fid)
+{
+	/* The root is never freed. */
+	if (fid == root_ || !get_node(fid))
+		return;
+
+	detach_child(fid);
+	writable_entry(fid) = InodeEntry{};
+	++dentry_epoch_;
+
+	if (static_cast<std::size_t>(fid) < change_flags_.size())
+		change_flags_[fid] = InodeChange::None;
+
+	Inode& node = writable_inode(fid);
+	node = Inode{};
+	node.next_sibling = static_cast<InodeLink>(free_head_);
+	free_head_ = fid;
+}
+
+void FileSystem::attach_child(NodeIdx fid, NodeIdx parent_fid)
+{
+	Inode& node = writable_inode(fid);
+	Inode& parent = writable_inode(parent_fid);
+	node.parent = static_cast<InodeLink>(parent_fid);
+	node.next_sibling = 0;
+	node.prev_sibling = parent.last_child;
+
+	if (parent.last_child != 0)
+		writable_inode(parent.last_child).next_sibling = static_cast<InodeLink>(fid);
+	else
+		parent.first_child = static_cast<InodeLink>(fid);
+
+	parent.last_child = static_cast<InodeLink>(fid);
+	++parent.num_children;
+
+	writable_children(parent_fid).insert_or_assign(entry(fid).name, static_cast<InodeLink>(fid));
+}
+
+void FileSystem::detach_child(NodeIdx fid)
+{
+	Inode& node = writable_inode(fid);
+	Inode& parent = writable_inode(node.parent);
+
+	(node.prev_sibling ? writable_inode(node.prev_sibling).next_sibling : parent.first_child) = node.next_sibling;
+	(node.next_sibling ? writable_inode(node.next_sibling).prev_sibling : parent.last_child) = node.prev_sibling;
+	--parent.num_children;
+
+	node.next_sibling = 0;
+	node.prev_sibling = 0;
+
+	/* A name that was taken over by a later file with the same path belongs to that file now. */
+	if (const DirEntryMap* children = entry(node.parent).children.get())
+	{
+		if (auto it = children->find(entry(fid).name); it != children->end() && it->second == fid)
+			writable_children(node.parent).erase(entry(fid).name);
+	}
+}
+
+void FileSystem::mark_changed(NodeIdx fid, InodeChange also)
+{
+	const std::size_t idx = static_cast<std::size_t>(fid);
+	if (idx >= change_flags_.size())
+		change_flags_.resize(num_slots_, InodeChange::None);
+
+	InodeChange& flags = change_flags_[idx];
+	if (flags == InodeChange::None)
+		changed_.push_back(fid);
+
+	set_flag<InodeChange, uint8_t>(flags, InodeChange::Changed);
+	set_flag<InodeChange, uint8_t>(flags, also);
+}
+
+void FileSystem::mark_removed(NodeIdx fid)
+{
+	if (static_cast<std::size_t>(fid) < change_flags_.size()
+		&& has_flag<InodeChange, uint8_t>(change_flags_[fid], InodeChange::Created))
+	{
+		return;
+	}
+
+	tombstones_.push_back(get_path(fid).get_string());
+}
+
 OpenFileHandle FileSystem::get_handle()
 {
 	if (free_handles_.empty())
@@ -81,3 +81,31 @@ bool Host::deserialize(const world::Host& from)
 {
 	return os_->deserialize(from);
 }
+
+bool Host::serialize_changes(world::Host* to)
+{
+	return os_->serialize_changes(to);
+}
+
+std::error_condition Host::save_image(const std::filesystem::path& path) const
+{
+	if (FileSystem* fs = os_ ? os_->get_filesystem() : nullptr)
+		return fs->save_image(path);
+
+	return {ENODEV, std::generic_category()};
+}
+
+std::error_condition Host::load_image(const std::filesystem::path& path)
+{
+	if (FileSystem* fs = os_ ? os_->get_filesystem() : nullptr)
+	{
+		/* As with deserialize, a loaded image is the new baseline for incremental snapshots. */
+		if (auto err = fs->load_image(path))
+			return err;
+
+		fs->clear_changes();
+		return {};
+	}
+
+	return {ENODEV, std::generic_category()};
+}
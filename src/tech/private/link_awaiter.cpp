@@ -1,6 +1,7 @@
 #include "link_awaiter.h"
 
 #include "nic.h"
+#include "run_queue.h"
 
 /* Begin LinkUpdateAwaiter --- */
 bool LinkUpdateAwaiter::await_ready()
@@ -10,10 +11,10 @@ bool LinkUpdateAwaiter::await_ready()
 
 void LinkUpdateAwaiter::await_suspend(std::coroutine_handle<> h)
 {
-	nic_->add_link_update_callback([this, h](const LinkUpdatePair& link)
+	nic_->add_link_update_callback([this, h, executor = RunQueue::current()](const LinkUpdatePair& link)
 	{
 		retval_ = link;
-		h.resume();
+		resume_on(executor, h);
 	});
 }
 
@@ -30,6 +30,7 @@ std::expected<OpenSocketPair, std::error_condition> NetManager::create_socket()
 	{
 		it->second.open = true;
 		it->second.handle = h;
+		it->second.serial = ++socket_serial_counter_;
 		return std::make_pair(h, &it->second);
 	}
 	else
@@ -77,9 +78,10 @@ Task<std::error_condition> NetManager::async_close_socket(OpenSocketHandle h)
 	{
 		OpenSocketEntry* entry = &it->second;
 
+		/* A dropped FIN is not retried; the peer finds out when its session times out. */
 		if (auto opt_reply = make_tcp_reply_ip(h, ip::TcpType::Fin, {}))
 		{
-			send(std::move(*opt_reply));
+			std::ignore = send(std::move(*opt_reply));
 		}
 		
 		while (socket_has_data(h))
@@ -130,9 +132,11 @@ Task<std::error_condition> NetManager::async_connect_socket(OpenSocketHandle soc
 		ip.set_protocol(ip::Protocol::TCP);
 		ip.set_payload(tcp_data);
 		
-		send(std::move(ip));
+		if (!send(std::move(ip)))
+			co_return std::error_condition{ENOBUFS, std::generic_category()};
 
-		auto race = co_await when_any(async_read_socket_tcp(sock), os_->wait(5.f));
+		std::stop_source stop{};
+		auto race = co_await when_any(stop, async_read_socket_tcp(sock, stop.get_token()), os_->wait(5.f));
 
 		if (race.index == 0)
 		{
@@ -165,33 +169,41 @@ Task<std::error_condition> NetManager::async_connect_socket(OpenSocketHandle soc
 	return async_connect_socket(sock, {addr, port});
 }
 
-Task<NetReadResult> NetManager::async_read_socket(OpenSocketHandle sock)
+Task<NetReadResult> NetManager::async_read_socket(OpenSocketHandle sock, std::stop_token stop)
 {
-	if (auto exp_pak = co_await async_read_socket_tcp(sock))
-	{
+	auto exp_pak = co_await async_read_socket_tcp(sock, std::move(stop));
+
+	if (exp_pak)
 		co_return exp_pak->payload();
-	}
 
-	co_return std::unexpected{std::error_condition{EIO, std::generic_category()}};
+	co_return std::unexpected{exp_pak.error()};
 }
 
-Task<NetReadResultTcp> NetManager::async_read_socket_tcp(OpenSocketHandle sock)
+Task<NetReadResultTcp> NetManager::async_read_socket_tcp(OpenSocketHandle sock, std::stop_token stop)
 {
-	if (auto exp_pak = co_await async_read_socket_raw(sock))
-	{
-		ip::TcpPacket tcp;
-		if (tcp.ParseFromString(exp_pak->payload()))
-			co_return tcp;
-	}
+	auto exp_pak = co_await async_read_socket_raw(sock, std::move(stop));
+
+	if (not exp_pak)
+		co_return std::unexpected{exp_pak.error()};
+
+	ip::TcpPacket tcp;
+	if (tcp.ParseFromString(exp_pak->payload()))
+		co_return tcp;
 
 	co_return std::unexpected{std::error_condition{EIO, std::generic_category()}};
 }
 
-Task<NetReadResultIp> NetManager::async_read_socket_raw(OpenSocketHandle sock)
+Task<NetReadResultIp> NetManager::async_read_socket_raw(OpenSocketHandle sock, std::stop_token stop)
 {
 	if (OpenSocketEntry* file = find_socket(sock))
 	{
-		co_return (co_await file->rx_queue.async_pop());
+		ip::IpPackage pak = co_await file->rx_queue.async_pop(stop);
+
+		/* A cancelled wait resumes with an empty package. */
+		if (stop.stop_requested() && pak.ByteSizeLong() == 0)
+			co_return std::unexpected{std::error_condition{ECANCELED, std::generic_category()}};
+
+		co_return pak;
 	}
 
 	co_return std::unexpected{std::error_condition{EIO, std::generic_category()}};
@@ -201,18 +213,45 @@ Task<size_t> NetManager::async_write_socket(OpenSocketHandle sock, std::string b
 {
 	if (bytes.size() == 0)
 		co_return 0;
-		
-	if (OpenSocketEntry* file = find_socket(sock))
+
+	OpenSocketEntry* file = find_socket(sock);
+	if (not file)
+		co_return 0;
+
+	auto pak = make_tcp_reply_ip(sock, ip::TcpType::Data, std::move(bytes));
+	if (not pak)
+		co_return 0;
+
+	size_t tx_size = pak->ByteSizeLong();
+	const uint64_t serial = file->serial;
+	const uint64_t ticket = file->tx_next_ticket++;
+
+	/* Nothing retransmits a lost segment, so a full tx queue is waited out (yielding so nettx can drain it)
+	instead of dropping the data. A failed push leaves the package as it was. */
+	for (int32_t attempt = 1; ; ++attempt)
 	{
-		if (auto pak = make_tcp_reply_ip(sock, ip::TcpType::Data, std::move(bytes)))
+		if (ticket == file->tx_serving && send(std::move(*pak)))
 		{
-			size_t tx_size = pak->ByteSizeLong();
-			send(std::move(*pak));
+			file->tx_serving++;
 			co_return tx_size;
 		}
-	}
 
-	co_return 0;
+		if (attempt >= socket_send_max_attempts)
+		{
+			/* A stream with a hole in it is worse than a closed one, so give up on the connection,
+			as TCP does once its retransmits run out. Writers queued behind this one see it closed. */
+			std::println("Socket {} stalled on a full tx queue; closing it.", sock);
+			close_socket(file);
+			co_return 0;
+		}
+
+		co_await os_->wait(socket_send_retry_interval);
+
+		/* The socket may have been closed while we waited, and its handle handed out again. */
+		file = find_socket(sock);
+		if (not file || file->serial != serial)
+			co_return 0;
+	}
 }
 
 Task<bool> NetManager::async_socket_test_alive(OpenSocketHandle sock)
@@ -222,9 +261,11 @@ Task<bool> NetManager::async_socket_test_alive(OpenSocketHandle sock)
 		auto pak = make_tcp_reply_ip(sock, ip::TcpType::Test, {});
 		if (not pak) { co_return false; }
 		
-		send(std::move(*pak));
+		if (!send(std::move(*pak)))
+			co_return false;
 
-		auto res = co_await when_any(async_read_socket_tcp(sock), os_->wait(1.f));
+		std::stop_source stop{};
+		auto res = co_await when_any(stop, async_read_socket_tcp(sock, stop.get_token()), os_->wait(1.f));
 		co_return (res.index == 0);
 	}
 
@@ -241,14 +282,14 @@ int32_t NetManager::listen(OpenSocketHandle sock)
 	return 1;
 }
 
-void NetManager::route(ip::IpPackage&& package)
+bool NetManager::route(ip::IpPackage&& package)
 {
-	routing_queue_.push(std::move(package));
+	return routing_queue_.push(std::move(package));
 }
 
-void NetManager::safe_rx(ip::IpPackage&& package)
+bool NetManager::safe_rx(ip::IpPackage&& package)
 {
-	nic_->get_rx_queue().push(std::move(package));
+	return nic_->get_rx_queue().push(std::move(package));
 }
 
 Task<std::expected<OpenSocketPair, std::error_condition>> NetManager::async_accept_socket(OpenSocketHandle sock)
@@ -291,7 +332,13 @@ Task<std::expected<OpenSocketPair, std::error_condition>> NetManager::async_acce
 
 			if (auto opt_reply = make_tcp_reply_ip(exp_h->first, ip::TcpType::Ack, ""))
 			{
-				send(std::move(*opt_reply));
+				/* Without the ACK the peer never learns of the session, so don't hand it out. */
+				if (!send(std::move(*opt_reply)))
+				{
+					close_socket(exp_h->first);
+					co_return std::unexpected{std::error_condition{ENOBUFS, std::generic_category()}};
+				}
+
 				co_return exp_h.value();
 			}
 		}
@@ -300,16 +347,16 @@ Task<std::expected<OpenSocketPair, std::error_condition>> NetManager::async_acce
 	co_return std::unexpected{std::error_condition{EIO, std::generic_category()}};
 }
 
-void NetManager::send(ip::IpPackage&& package)
+bool NetManager::send(ip::IpPackage&& package)
 {
 	assert(nic_);
-	nic_->get_tx_queue().push(std::move(package));
+	return nic_->get_tx_queue().push(std::move(package));
 }
 
-void NetManager::send(ip::IpPackage&& package, Uid64 mac)
+bool NetManager::send(ip::IpPackage&& package, Uid64 mac)
 {
 	assert(nic_);
-	nic_->transfer(mac, std::move(package));
+	return nic_->transfer(mac, std::move(package)) > 0;
 }
 
 void NetManager::receive(ip::IpPackage&& package)
@@ -384,7 +431,9 @@ void NetManager::handle_packet(ip::IcmpPacket&& packet, ip::IpPackage&& outer, c
 				pak.set_src_ip(get_primary_ip().raw);
 				pak.set_protocol(ip::Protocol::ICMP);
 				pak.set_payload(ret_str);
-				send(std::move(pak));
+
+				/* Echo replies are best-effort, as on a real host. */
+				std::ignore = send(std::move(pak));
 			}
 			break;
 		}
@@ -441,7 +490,7 @@ void NetManager::handle_packet(ip::TcpPacket&& packet, ip::IpPackage&& outer, co
 			if (OpenSocketEntry* sock = find_socket(sess))
 			{
 				auto opt_rep = make_tcp_reply_ip(sock->handle, ip::TcpType::Ack, {});
-				send(std::move(*opt_rep));
+				std::ignore = send(std::move(*opt_rep));
 			}
 			break;
 		}
@@ -654,13 +703,14 @@ LinkUpdateAwaiter NetManager::async_await_link()
 	return LinkUpdateAwaiter{nic_};
 }
 
+/* The linked NICs may belong to hosts on other shards, but the callbacks run here, on the caller's strand,
+so only this host's cache is written. All they read of the other NIC is its address, which is fixed before
+it is linked (see NIC::set_ip), so no lock is needed. */
 void NetManager::arp_request()
 {
 	nic_->broadcast([this](Uid64 mac, NIC* nic)
 	{
-		Address6 addr = nic->get_ip();
-		arp_cache_[addr] = mac;
-		std::println("- ARP entry: {} -> {}", addr, mac);
+		arp_cache_[nic->get_ip()] = mac;
 	});
 }
 
@@ -668,9 +718,7 @@ void NetManager::arp_request(Uid64 mac)
 {
 	nic_->unicast(mac, [this](Uid64 mac, NIC* nic)
 	{
-		Address6 addr = nic->get_ip();
-		arp_cache_[addr] = mac;
-		std::println("- ARP entry: {} -> {}", addr, mac);
+		arp_cache_[nic->get_ip()] = mac;
 	});
 }
 
@@ -12,7 +12,13 @@ NIC::~NIC() = default;
 
 void NIC::set_ip(const std::string& new_ip)
 {
-	address_ = Address6::from_string(new_ip).value_or(Address6{0});
+	set_ip(Address6::from_string(new_ip).value_or(Address6{0}));
+}
+
+void NIC::set_ip(const Address6& new_ip)
+{
+	assert(link_cache_.empty());
+	address_ = new_ip;
 }
 
 void NIC::on_linked(LinkServer* links, ILinkable* other)
@@ -57,8 +63,9 @@ size_t NIC::transfer(Uid64 mac, ip::IpPackage&& packet)
 	{
 		size_t bytes = packet.ByteSizeLong();
 		NIC* other = it->second;
-		other->rx_queue_.push(std::move(packet));
-		return bytes;
+
+		/* Dropped if the receiver's queue is full. */
+		return other->rx_queue_.push(std::move(packet)) ? bytes : 0;
 	}
 
 	return 0;
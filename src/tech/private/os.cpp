@@ -7,6 +7,7 @@
 
 #include "game_srv.h"
 #include "timer_base.h"
+#include "run_queue.h"
 
 #include "proto/host.pb.h"
 #include "proto/files.pb.h"
@@ -124,6 +125,18 @@ void OS::kill_process(int32_t pid)
 }
 
 EagerTask<int32_t> OS::run_process(ProcessFn program, std::vector<std::string> args, CreateProcessParams&& params)
+{
+    RunQueue* executor = owner_.get_executor();
+
+    if (executor == nullptr || RunQueue::current() == executor)
+        return run_process_internal(std::move(program), std::move(args), std::move(params));
+
+    /* The task is eager, so it runs up to its first suspension within this scope. */
+    RunQueue::Scope scope{*executor};
+    return run_process_internal(std::move(program), std::move(args), std::move(params));
+}
+
+EagerTask<int32_t> OS::run_process_internal(ProcessFn program, std::vector<std::string> args, CreateProcessParams&& params)
 {
     Proc* proc = create_process(std::forward<CreateProcessParams>(params));
     int32_t pid = proc->get_pid();
@@ -181,12 +194,12 @@ NetManager* OS::get_network_manager()
 
 TimerAwaiter OS::wait(float seconds)
 {
-	return services_->timers.wait(seconds);
+	return services_->timers.wait(timer_seconds(seconds));
 }
 
 void OS::schedule(float seconds, SchedulerFn callback)
 {
-    services_->timers.set_timer(seconds, callback);
+    services_->timers.set_timer(timer_seconds(seconds), std::move(callback));
 }
 
 bool OS::serialize(world::Host* to)
@@ -196,11 +209,26 @@ bool OS::serialize(world::Host* to)
 
 	world::FileSystem* to_fs = to->mutable_files();
     if (FileSystem* fs = get_filesystem())
+    {
         fs->serialize(to_fs);
+        fs->clear_changes();
+    }
 
 	return true;
 }
 
+bool OS::serialize_changes(world::Host* to)
+{
+    to->set_hostname(get_hostname());
+    to->set_addr(net_.get_primary_ip().raw);
+
+    world::FileSystem* to_fs = to->mutable_files();
+    if (FileSystem* fs = get_filesystem())
+        fs->serialize_changes(to_fs);
+
+    return true;
+}
+
 bool OS::deserialize(const world::Host& from)
 {
     hostname_ = from.hostname();
@@ -208,7 +236,10 @@ bool OS::deserialize(const world::Host& from)
 
     const world::FileSystem& from_fs = from.files();
     if (FileSystem* fs = get_filesystem())
+    {
         fs->deserialize(from_fs);
+        fs->clear_changes();
+    }
 
 	return true;
 }
@@ -9,6 +9,7 @@
 #include <iomanip>
 #include <sstream>
 #include <string>
+#include <stop_token>
 
 #include <signal.h>
 
@@ -50,11 +51,16 @@ void Proc::set_reader(ReaderFn&& reader)
 	reader_ = std::move(reader);
 }
 
-Task<ReadResult> Proc::read(EnvVarAccessMode mode)
+Task<ReadResult> Proc::read(EnvVarAccessMode mode, std::stop_token stop)
 {
+	/* Readers are plain tasks, so when_any can't cancel one that loses; it is stopped instead,
+	which takes it off the input queue. The caller's stop is passed on the same way. */
+	std::stop_source race_stop{};
+	std::stop_callback chain(stop, [&race_stop] { race_stop.request_stop(); });
+
 	if (reader_)
 	{
-		auto res = co_await when_any(reader_(*this), ProcSignalAwaiter{this});
+		auto res = co_await when_any(race_stop, reader_(*this, race_stop.get_token()), ProcSignalAwaiter{this});
 		if (res.index == 0)
 		{
 			co_return std::get<1>(res.value);
@@ -64,7 +70,7 @@ Task<ReadResult> Proc::read(EnvVarAccessMode mode)
 
 	if (host && mode == EnvVarAccessMode::Inherit)
 	{
-		auto res = co_await when_any(host->read(), ProcSignalAwaiter{this});
+		auto res = co_await when_any(race_stop, host->read(mode, race_stop.get_token()), ProcSignalAwaiter{this});
 		if (res.index == 0)
 		{
 			co_return std::get<1>(res.value);
@@ -77,7 +83,10 @@ Task<ReadResult> Proc::read(EnvVarAccessMode mode)
 
 Task<ReadResult> Proc::read(float timeout, EnvVarAccessMode mode)
 {
-	auto res = co_await when_any(read(mode), wait(timeout));
+	/* Race the bare timer rather than Proc::wait, so the timer is cancelled when the read wins.
+	A signal still interrupts the read itself, and a timeout stops it. */
+	std::stop_source stop{};
+	auto res = co_await when_any(stop, read(mode, stop.get_token()), owning_os->wait(timeout));
 	if (res.index == 0)
 	{
 		co_return std::get<1>(res.value);
@@ -145,17 +154,24 @@ Task<std::error_condition> Proc::wait(float seconds)
 	co_return (res.index == 0) ? std::error_condition{} : std::error_condition{EINTR, std::generic_category()};
 }
 
-void Proc::add_signal_callback(SignalCallbackFn&& fn)
+uint64_t Proc::add_signal_callback(SignalCallbackFn&& fn)
+{
+	uint64_t id = ++signal_callback_counter_;
+	signal_callbacks_.emplace_back(id, std::move(fn));
+	return id;
+}
+
+bool Proc::remove_signal_callback(uint64_t id)
 {
-	signal_callbacks_.push_back(std::move(fn));
+	return std::erase_if(signal_callbacks_, [id](const auto& pair) { return pair.first == id; }) > 0;
 }
 
 void Proc::signal(SignalType sig)
 {
-	std::vector<SignalCallbackFn> empty_{};
+	std::vector<std::pair<uint64_t, SignalCallbackFn>> empty_{};
 	std::swap(signal_callbacks_, empty_);
 
-	for (auto&& fn : empty_)
+	for (auto&& [id, fn] : empty_)
 	{
 		fn(sig);
 	}
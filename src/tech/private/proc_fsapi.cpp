@@ -6,6 +6,8 @@
 #include "proc.h"
 #include "os.h"
 
+#include <utility>
+
 #include <iso646.h>
 
 /* --- Helpers --- */
@@ -133,7 +135,46 @@ std::expected<std::string_view, std::error_condition> ProcFsApi::read(FileDescri
 		const OpenFileTablePair& pair = it->second;
 		OpenFileHandle h = pair.first;
 		
-		return fs.read(h, 0); // TODO: Add support for reading some bytes only.
+		return fs.read(h, 0);
+	}
+	
+	return std::unexpected{std::error_condition{EBADF, std::generic_category()}};
+}
+
+std::expected<std::string_view, std::error_condition> ProcFsApi::read(FileDescriptor fd, size_t bytes) const
+{
+	if (auto it = fd_table_.find(fd); it != fd_table_.end())
+	{
+		const OpenFileTablePair& pair = it->second;
+		OpenFileHandle h = pair.first;
+		
+		return fs.read(h, bytes);
+	}
+	
+	return std::unexpected{std::error_condition{EBADF, std::generic_category()}};
+}
+
+std::expected<std::string, std::error_condition> ProcFsApi::pread(FileDescriptor fd, size_t offset, size_t bytes) const
+{
+	if (auto it = fd_table_.find(fd); it != fd_table_.end())
+	{
+		const OpenFileTablePair& pair = it->second;
+		OpenFileHandle h = pair.first;
+		
+		return fs.pread(h, offset, bytes);
+	}
+	
+	return std::unexpected{std::error_condition{EBADF, std::generic_category()}};
+}
+
+std::expected<size_t, std::error_condition> ProcFsApi::pwrite(FileDescriptor fd, size_t offset, std::string_view data) const
+{
+	if (auto it = fd_table_.find(fd); it != fd_table_.end())
+	{
+		const OpenFileTablePair& pair = it->second;
+		OpenFileHandle h = pair.first;
+		
+		return fs.pwrite(h, offset, data);
 	}
 	
 	return std::unexpected{std::error_condition{EBADF, std::generic_category()}};
@@ -148,7 +189,7 @@ std::expected<ProcessFn, std::error_condition> ProcFsApi::read_exe(FileDescripto
 		
 		if (auto exp_file = fs.get(h))
 		{
-			File* file = exp_file.value();
+			const File* file = exp_file.value();
 			return file->get_executable();
 		}
 	}
@@ -156,14 +197,14 @@ std::expected<ProcessFn, std::error_condition> ProcFsApi::read_exe(FileDescripto
 	return std::unexpected{std::error_condition{EBADF, std::generic_category()}};
 }
 
-std::expected<FileMeta*, std::error_condition> ProcFsApi::get_metadata(FileDescriptor fd) const
+std::expected<const FileMeta*, std::error_condition> ProcFsApi::get_metadata(FileDescriptor fd) const
 {
 	if (auto it = fd_table_.find(fd); it != fd_table_.end())
 	{
 		const OpenFileTablePair& pair = it->second;
 		OpenFileTableEntry* entry = pair.second;
 		
-		FileMeta* meta = fs.get_metadata(entry->node);
+		const FileMeta* meta = std::as_const(fs).get_metadata(entry->node);
 
 		if (meta) { return meta; }
 
@@ -205,9 +246,9 @@ bool ProcFsApi::check_permission(NodeIdx node, FileAccessFlags mode)
 	if (uid == 0 || gid == 0)
 		return true;
 
-	if (FileMeta* meta_ptr = fs.get_metadata(node))
+	if (const FileMeta* meta_ptr = std::as_const(fs).get_metadata(node))
 	{
-		FileMeta& meta = *meta_ptr;
+		const FileMeta& meta = *meta_ptr;
 
 		bool group_match = (gid == meta.owner_gid || users.check_belongs(uid, meta.owner_gid));
 		bool owner_match = (uid == meta.owner_uid);
@@ -347,4 +388,27 @@ bool ProcFsApi::remove_using(const FilePath& path, FileRemoverFn&& func)
 
 	func(fs, path, std::error_condition{ENOENT, std::generic_category()});
 	return false;
+}
+
+std::error_condition ProcFsApi::move(const FilePath& from, const FilePath& to)
+{
+	if (NodeIdx fid = fs.get_fid(from))
+	{
+		NodeIdx from_parent = fs.get_parent_folder(fid);
+		NodeIdx to_parent = fs.get_fid(to.get_parent_path());
+
+		if (to_parent == 0)
+			return std::error_condition{ENOENT, std::generic_category()};
+
+		/* Both directories gain or lose an entry. */
+		if (not check_permission(from_parent, FileAccessFlags::Write | FileAccessFlags::Execute))
+			return std::error_condition{EACCES, std::generic_category()};
+
+		if (not check_permission(to_parent, FileAccessFlags::Write | FileAccessFlags::Execute))
+			return std::error_condition{EACCES, std::generic_category()};
+
+		return fs.move_file(fid, to);
+	}
+
+	return std::error_condition{ENOENT, std::generic_category()};
 }
\ No newline at end of file
@@ -125,35 +125,35 @@ Task<DescriptorResult> ProcNetApi::async_accept_socket(FileDescriptor sock)
 	else co_return std::unexpected{std::error_condition{EBADF, std::generic_category()}};
 }
 
-Task<NetReadResult> ProcNetApi::async_read_socket(FileDescriptor sock) const
+Task<NetReadResult> ProcNetApi::async_read_socket(FileDescriptor sock, std::stop_token stop) const
 {
 	if (auto it = fd_table_.find(sock); it != fd_table_.end())
 	{
 		const OpenSocketPair& pair = it->second;
 		OpenSocketHandle h = pair.first;
-		co_return (co_await net_->async_read_socket(h));
+		co_return (co_await net_->async_read_socket(h, std::move(stop)));
 	}
 	else co_return std::unexpected{std::error_condition{EBADF, std::generic_category()}};
 }
 
-Task<NetReadResultTcp> ProcNetApi::async_read_socket_tcp(FileDescriptor sock) const
+Task<NetReadResultTcp> ProcNetApi::async_read_socket_tcp(FileDescriptor sock, std::stop_token stop) const
 {
 	if (auto it = fd_table_.find(sock); it != fd_table_.end())
 	{
 		const OpenSocketPair& pair = it->second;
 		OpenSocketHandle h = pair.first;
-		co_return (co_await net_->async_read_socket_tcp(h));
+		co_return (co_await net_->async_read_socket_tcp(h, std::move(stop)));
 	}
 	else co_return std::unexpected{std::error_condition{EBADF, std::generic_category()}};
 }
 
-Task<NetReadResultIp> ProcNetApi::async_read_socket_raw(FileDescriptor sock) const
+Task<NetReadResultIp> ProcNetApi::async_read_socket_raw(FileDescriptor sock, std::stop_token stop) const
 {
 	if (auto it = fd_table_.find(sock); it != fd_table_.end())
 	{
 		const OpenSocketPair& pair = it->second;
 		OpenSocketHandle h = pair.first;
-		co_return (co_await net_->async_read_socket_raw(h));
+		co_return (co_await net_->async_read_socket_raw(h, std::move(stop)));
 	}
 	else co_return std::unexpected{std::error_condition{EBADF, std::generic_category()}};
 }
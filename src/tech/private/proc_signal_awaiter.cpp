@@ -1,6 +1,7 @@
 #include "proc_signal_awaiter.h"
 
 #include "proc.h"
+#include "run_queue.h"
 
 ProcSignalAwaiter::ProcSignalAwaiter(Proc* proc)
 	: proc_(proc) {}
@@ -13,9 +14,14 @@ ProcSignalAwaiter::~ProcSignalAwaiter()
 void ProcSignalAwaiter::await_suspend(std::coroutine_handle<> h)
 {
 	assert(proc_);
-	proc_->add_signal_callback([this, h](SignalType sig)
+	callback_id_ = proc_->add_signal_callback([this, h, executor = RunQueue::current()](SignalType sig)
 	{
 		signal_ = sig;
-		h.resume();
+		resume_on(executor, h);
 	});
+}
+
+bool ProcSignalAwaiter::cancel()
+{
+	return callback_id_ != 0 && proc_->remove_signal_callback(callback_id_);
 }
\ No newline at end of file
@@ -114,7 +114,7 @@ EagerTask<int32_t> ProcSysApi::exec(std::vector<std::string>&& args)
 			co_return 1;
 		}
 
-		FileMeta* meta = exp_meta.value();
+		const FileMeta* meta = exp_meta.value();
 		bool setuid = fs.has_flag<ExtraFileFlags>(meta->extra, ExtraFileFlags::SetUid);
 		bool setgid = fs.has_flag<ExtraFileFlags>(meta->extra, ExtraFileFlags::SetGid);
 		int32_t exec_uid = setuid ? meta->owner_uid : proc.get_uid();
@@ -0,0 +1,32 @@
+#pragma once
+
+#include <cstddef>
+#include <memory>
+#include <string>
+
+/* Process-wide store of file content chunks, keyed by their SHA-256 digest.
+Hosts are built from the same skeleton and handed the same files, so identical chunks
+are kept once and shared between every file (on every host) that holds them.
+The store keeps a reference of its own, so a stored chunk always looks shared
+and is copied by FileContent before it is modified. */
+namespace ContentStore
+{
+	/* Chunks smaller than this are not worth a table entry. */
+	constexpr std::size_t min_size = 64;
+
+	struct ContentStats
+	{
+		std::size_t num_chunks{0};			// Distinct chunks in use.
+		std::size_t stored_bytes{0};		// Bytes those take, once each.
+		std::size_t referenced_bytes{0};	// Bytes as seen by the files holding them.
+
+		/* How many times over the stored bytes are used; 1 means nothing is shared. */
+		double dedup_ratio() const { return stored_bytes ? static_cast<double>(referenced_bytes) / stored_bytes : 1.0; }
+	};
+
+	/* Replaces the chunk with the stored one of the same content, or stores it if it is new. */
+	void intern(std::shared_ptr<std::string>& chunk);
+
+	/* Walks the table, so meant for occasional reporting rather than every tick. */
+	ContentStats get_stats();
+}
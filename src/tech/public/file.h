@@ -1,6 +1,7 @@
 #pragma once
 
 #include "proc_types.h"
+#include "file_content.h"
 
 #include <string>
 #include <sstream>
@@ -31,19 +32,51 @@ public:
 	virtual std::optional<std::string> eat();
 	
 	void append(std::string content);
+
+	/* Share this file's content with any identical content in the store (see ContentStore).
+	Called where duplicates come from, such as creating or loading files, and never on the write path. */
+	void intern();
+
+	/* Copy out up to 'bytes' bytes from 'offset', without moving anything. */
+	std::string pread(std::size_t offset, std::size_t bytes) const;
+
+	/* Write at 'offset', growing the file as needed. Returns the number of bytes written. */
+	std::size_t pwrite(std::size_t offset, std::string_view data);
+
+	/* Up to 'bytes' bytes from 'offset' without copying; may come up short, at a chunk boundary. */
+	std::string_view view(std::size_t offset, std::size_t bytes) const;
 	
 	std::size_t size() const;
 	
+	/* The whole content in one piece. A file larger than one chunk is joined into a cached copy,
+	which lives until the file is next modified. */
 	std::string_view get_view() const;
 	std::stringstream get_stream() const;
 	const std::string& get_string() const;
 	const ProcessFn& get_executable() const;
 
+	/* Marks the file as shared between file systems, as the files of a base image are. A frozen file is only read;
+	a file system that wants to change it writes to a clone instead. */
+	void freeze();
+	bool is_frozen() const { return frozen_; }
+
+	/* A new file with the same content and program, sharing the content's chunks. The clone is not frozen. */
+	virtual std::shared_ptr<File> clone() const;
+
+	/* The chunked content itself; copying it shares the chunks. */
+	const FileContent& get_content() const { return content_; }
+	void set_content(FileContent content);
+
 protected:
 
+	void invalidate_flat();
 
 	uint64_t fid_{};
-	std::string content_{};
+	FileContent content_{};
 	ProcessFn executable_{nullptr};
 
+	mutable std::string flat_{};
+	mutable bool flat_valid_{false};
+	bool frozen_{false};
+
 };
\ No newline at end of file
@@ -0,0 +1,69 @@
+#pragma once
+
+#include <string>
+#include <string_view>
+#include <vector>
+#include <memory>
+#include <optional>
+#include <cstddef>
+
+/* The data of a file, kept in fixed-size chunks. Copies share their chunks, and a chunk is only
+copied once it is written to while shared. Every chunk but the last is full, so an offset maps
+straight to its chunk, and appending never moves what is already there.
+Content can also be external (eg. in a mapped file image): it is then read in place,
+and only copied into chunks when first modified. */
+class FileContent
+{
+public:
+
+	static constexpr std::size_t chunk_size = 4096;
+
+	std::size_t size() const { return size_; }
+	bool empty() const { return size_ == 0; }
+
+	/* Replace all content. */
+	void assign(std::string data);
+	void clear();
+
+	/* Replace all content with bytes owned by someone else, which the owner handle keeps alive. */
+	void assign_external(std::shared_ptr<const void> owner, std::string_view data);
+	bool is_external() const { return owner_ != nullptr; }
+
+	/* Swap each chunk for the shared copy in the content store, if another file already holds the same bytes. */
+	void intern();
+
+	/* Add to the end; amortised constant time per byte, whatever the size of the file. */
+	void append(std::string_view data);
+
+	/* Copy out up to 'bytes' bytes, starting at 'offset'. */
+	std::string read(std::size_t offset, std::size_t bytes) const;
+
+	/* Write over the content from 'offset', growing it as needed. A gap past the end is filled with zeroes. */
+	std::size_t write(std::size_t offset, std::string_view data);
+
+	/* Up to 'bytes' bytes from 'offset', without copying; stops short at the end of a chunk. */
+	std::string_view view(std::size_t offset, std::size_t bytes) const;
+
+	/* The content as a string if it is held in a single chunk (or none), otherwise nullptr. */
+	const std::string* contiguous() const;
+
+	/* The whole content without copying, if it is in one piece (one chunk, or external). */
+	std::optional<std::string_view> contiguous_view() const;
+
+	/* All chunks, joined. */
+	std::string flatten() const;
+
+private:
+
+	/* Returns a chunk that is safe to modify, copying it first if it is shared. */
+	std::string& writable_chunk(std::size_t idx);
+
+	/* Copies external content into chunks of our own, before it is modified. */
+	void internalise();
+
+	std::vector<std::shared_ptr<std::string>> chunks_{};
+	std::size_t size_{0};
+
+	std::shared_ptr<const void> owner_{};
+	std::string_view external_{};
+};
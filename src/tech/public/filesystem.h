@@ -14,17 +14,111 @@
 #include <concepts>
 #include <tuple>
 #include <chrono>
+#include <array>
+#include <string>
+#include <string_view>
+#include <type_traits>
+#include <filesystem>
 
 struct SessionData;
 
 namespace world { class FileSystem; }
 
+/* Tree links within the inode table are fids narrowed to 32 bits; 0 means none. */
+using InodeLink = uint32_t;
+
+/* One entry in the inode table: everything a stat or a directory walk needs, in one cache line.
+A slot is in use while it has a parent; the root is its own parent. */
+struct alignas(64) Inode
+{
+	std::shared_ptr<File> file{};
+	FileMeta meta{};
+	InodeLink parent{0};
+	InodeLink first_child{0};
+	InodeLink last_child{0};
+	InodeLink next_sibling{0};
+	InodeLink prev_sibling{0};
+	InodeLink num_children{0};
+};
+
+static_assert(sizeof(Inode) == 64, "An inode should fill exactly one cache line.");
+
+struct DirEntryHash
+{
+	using is_transparent = void;
+	std::size_t operator()(std::string_view name) const { return std::hash<std::string_view>{}(name); }
+};
+
+/* Name to child fid, for one directory. Looked up by string_view, so walking a path doesn't allocate. */
+using DirEntryMap = std::unordered_map<std::string, InodeLink, DirEntryHash, std::equal_to<>>;
+
+/* Cold per-inode data, kept out of the inode table: the entry's own name,
+and once it has children, the index of their names. The index is shared with a base image
+until one of them changes it. */
+struct InodeEntry
+{
+	std::string name{};
+	std::shared_ptr<DirEntryMap> children{};
+};
+
+/* The inode table is held in pages of this many slots (a page of inodes is 4 KiB), which file systems made
+from the same base image share until they write to them. */
+constexpr std::size_t inode_page_size = 64;
+
+template<typename T>
+using TablePage = std::array<T, inode_page_size>;
+
+template<typename T>
+using PagedTable = std::vector<std::shared_ptr<TablePage<T>>>;
+
+enum class WalkOrder : uint8_t
+{
+	PreOrder,	// Each directory before its contents.
+	PostOrder	// Each directory after its contents, so a walk may remove what it yields.
+};
+
+/* What a walk filter decides for each file, as the walk reaches it. A filter may also return a bool,
+where true means Enter and false means Skip. */
+enum class WalkStep : uint8_t
+{
+	Enter,	// Yield the file, and walk its contents.
+	Visit,	// Yield the file, but not its contents.
+	Skip	// Yield neither the file nor its contents.
+};
+
+/* What has happened to a file since the last save, for incremental snapshots. */
+enum class InodeChange : uint8_t
+{
+	None = 0,
+	Changed = 1 << 0,	// Content or metadata.
+	Created = 1 << 1,	// Not in the last save at all, so removing it needs no tombstone.
+	Subtree = 1 << 2	// Moved; everything below has a new path too.
+};
+
+struct WalkEverything
+{
+	WalkStep operator()(NodeIdx) const { return WalkStep::Enter; }
+};
+
 class FileSystem
 {
 public:
 
+	template<typename Filter>
+	class Walk;
+
 	FileSystem();
 
+	/* Marks every file as shared, so that this file system can serve as a base image. Once frozen,
+	it should not be changed; file systems made from it copy what they change, and keep the rest in common. */
+	void freeze();
+	bool is_frozen() const { return frozen_; }
+
+	/* Replaces the whole tree with that of a frozen base image, in constant time. Pages of the inode table and files
+	are shared with the base until this file system changes them, so it only pays for its own differences:
+	a changed or removed file copies its page, a changed file is copied on first write. Call before opening any file. */
+	void use_base(const FileSystem& base);
+
 	/* Returns whether file handle is valid. This is not the opposite of is_dir, as a directory is a file. */
 	bool is_file(NodeIdx fid) const;
 	bool is_file(const FilePath& path) const;
@@ -42,13 +136,16 @@ public:
 	/* Returns the filename of a valid file handle, otherwise an empty string. */
 	std::string_view get_filename(NodeIdx fid) const;
 
-	/* Returns the path of a valid file handle, or an empty path. */
+	/* Returns the path of a valid file handle, or an empty path. Paths are not stored, but rebuilt from the names up to the root. */
 	FilePath get_path(NodeIdx fid) const;
 
 	/* Returns the file ID corresponding to a fully-qualified path. Returns 0 if no such file exists.
 	Returns root id for empty or single-slash paths. */
 	NodeIdx get_fid(const FilePath& path) const;
 
+	/* Returns the child of a directory with the given name, or 0. */
+	NodeIdx get_child(NodeIdx dir, std::string_view name) const;
+
 	/* Return the number of children of this node. */
 	std::size_t get_links(NodeIdx fid);
 
@@ -67,8 +164,10 @@ public:
 	/* Returns the last-modified date (seconds since epoch). */
 	uint64_t get_last_modified(NodeIdx fid);
 
-	/* Returns metadata for a file id, or nullptr if the file does not exist. */
+	/* Returns metadata for a file id, or nullptr if the file does not exist.
+	The non-const version is for changing it, and counts as a change to the file. */
 	FileMeta* get_metadata(NodeIdx fid);
+	const FileMeta* get_metadata(NodeIdx fid) const;
 
 	std::vector<NodeIdx> get_files(NodeIdx fid, bool recurse = false) const;
 	std::vector<NodeIdx> get_files(const FilePath& path, bool recurse = false) const;
@@ -76,6 +175,15 @@ public:
 	std::vector<FilePath> get_paths(NodeIdx fid, bool recurse = false) const;
 	std::vector<FilePath> get_paths(const FilePath& path, bool recurse = false) const;
 
+	/* Lazily walks everything below a file (but not the file itself), depth first and without allocating.
+	The filter is called once per file, when the walk reaches it; breaking out of the loop ends the walk.
+	A walk is single-pass. During a post-order walk, the file just yielded may be removed. */
+	template<typename Filter = WalkEverything>
+	Walk<Filter> walk(NodeIdx fid, WalkOrder order = WalkOrder::PreOrder, Filter filter = {}) const
+	{
+		return Walk<Filter>(this, fid, order, std::move(filter));
+	}
+
 	NodeIdx get_parent_folder(NodeIdx fid) const;
 	NodeIdx get_root() const { return root_; }
 	std::vector<NodeIdx> get_root_chain(NodeIdx fid) const;
@@ -103,12 +211,19 @@ public:
 	bool remove_file(NodeIdx fid, FileRemoverFn&& func);
 	bool remove_file(const FilePath& path, FileRemoverFn&& func);
 
+	/* Moves (and/or renames) a file to a new path, whose parent must exist. A directory takes its contents with it;
+	the cost does not depend on their number. Fails with EEXIST if the target exists, or EINVAL if moving a directory into itself. */
+	std::error_condition move_file(NodeIdx fid, const FilePath& to);
+	std::error_condition move_file(const FilePath& from, const FilePath& to);
+
 	/* Returns a pointer to a file, if found; otherwise nullptr. */
 	FileOpResult get_file(NodeIdx fid, FileAccessFlags flags = FileAccessFlags::All);
 	FileOpResult get_file(const FilePath& path, FileAccessFlags flags = FileAccessFlags::All);
 	
-	/* Basic find function for low-level code, without file scope. Prefer 'open' to using this. */
+	/* Basic find function for low-level code, without file scope. Prefer 'open' to using this.
+	The file is for writing, so a file shared with a base image is copied first; the const version never copies. */
 	File* find(NodeIdx fid);
+	const File* find(NodeIdx fid) const;
 
 	static void set_flag(FilePermissionTriad& base, FilePermissionTriad set_flags);
 	static void clear_flag(FilePermissionTriad& base, FilePermissionTriad clear_flags);
@@ -157,23 +272,13 @@ public:
 		if (parent_fid == 0)
 			return std::make_tuple(0, nullptr, std::error_condition{ENOENT, std::generic_category()});
 
-		NodeIdx fid = ++fid_counter_;
-		auto [it, success] = files_.emplace(fid, std::make_shared<T>(fid));
+		NodeIdx fid = alloc_node();
+		auto file = std::make_shared<T>(fid);
+		link_node(fid, parent_fid, path.get_name(), meta, file);
 
-		if (success)
-		{
-			fid_to_path_[fid] = path;
-			path_to_fid_[path] = fid;
-			roots_[fid] = parent_fid;
-			metadata_[fid] = meta;
-			mappings_.insert(std::make_pair(parent_fid, fid));
-
-			file_set_modified_now(fid);
-
-			return std::make_tuple(fid, it->second, std::error_condition{});
-		}
+		file_set_modified_now(fid);
 
-		return std::make_tuple(fid, nullptr, std::error_condition{EIO, std::generic_category()});
+		return std::make_tuple(fid, std::move(file), std::error_condition{});
 	}
 
 	template<std::derived_from<File> T>
@@ -189,7 +294,10 @@ public:
 		if (auto [fid, ptr, err] = res; err.value() == 0)
 		{
 			if (!params.content.empty()) 
+			{
 				ptr->write(params.content);
+				ptr->intern();
+			}
 				
 			if (params.executable)
 				ptr->write(params.executable);
@@ -202,13 +310,39 @@ public:
 	OpenFileTablePair open_file_entry(NodeIdx node, FileAccessFlags flags);
 	void close_file_entry(OpenFileHandle h);
 
+	/* Replaces the content, or appends to it if the file was opened for appending, and moves the offset to the end. */
 	std::expected<size_t, std::error_condition> write(OpenFileHandle h, std::string data);
+
+	/* With 0 bytes, returns the whole content and leaves the offset alone.
+	Otherwise reads up to 'bytes' from the handle's offset and moves past them; a read may come up short
+	at a chunk boundary, and is empty at the end of the file. The view is valid until the file is modified. */
 	std::expected<std::string_view, std::error_condition> read(OpenFileHandle h, size_t bytes);
-	std::expected<File*, std::error_condition> get(OpenFileHandle h);
+
+	/* Read or write at an explicit offset, leaving the handle's offset alone. */
+	std::expected<std::string, std::error_condition> pread(OpenFileHandle h, size_t offset, size_t bytes);
+	std::expected<size_t, std::error_condition> pwrite(OpenFileHandle h, size_t offset, std::string_view data);
+	std::expected<const File*, std::error_condition> get(OpenFileHandle h) const;
 
 	bool serialize(world::FileSystem* to) const;
 	bool deserialize(const world::FileSystem& from);
 
+	/* Writes only what changed since the last save: tombstones for paths removed (or moved away from),
+	then each file created or changed. Loading it with deserialize on top of the previous snapshot brings that up to date.
+	The changes are forgotten once written, so a save costs time in the number of changes rather than of files. */
+	bool serialize_changes(world::FileSystem* to);
+
+	/* Forgets all changes, making the current tree the base for the next serialize_changes (eg. after a full save). */
+	void clear_changes();
+	bool has_changes() const { return !changed_.empty() || !tombstones_.empty(); }
+
+	/* Writes the whole tree to a flat image file, which load_image can map back in without parsing. */
+	std::error_condition save_image(const std::filesystem::path& path) const;
+
+	/* Maps an image written by save_image, and merges it in the way deserialize does.
+	File contents are read in place from the mapping until they are modified,
+	so the files of an idle host cost page cache rather than heap. */
+	std::error_condition load_image(const std::filesystem::path& path);
+
 
 protected:
 
@@ -217,18 +351,268 @@ protected:
 
 private:
 
+	/* Returns the inode of a live file, or nullptr. */
+	const Inode* get_node(NodeIdx fid) const;
+
+	/* As get_node, but for changing the inode: its page is copied first if it is shared. */
+	Inode* get_writable_node(NodeIdx fid);
+
+	/* Any slot in the table, live or not. */
+	const Inode& inode(NodeIdx fid) const { return slot(inodes_, fid); }
+	const InodeEntry& entry(NodeIdx fid) const { return slot(entries_, fid); }
+
+	template<typename T>
+	static const T& slot(const PagedTable<T>& table, NodeIdx fid)
+	{
+		const std::size_t idx = static_cast<std::size_t>(fid);
+		return (*table[idx / inode_page_size])[idx % inode_page_size];
+	}
+	Inode& writable_inode(NodeIdx fid) { return writable_slot(inodes_, fid); }
+	InodeEntry& writable_entry(NodeIdx fid) { return writable_slot(entries_, fid); }
+
+	/* A slot of a table, whose page is copied first if another file system still uses it. */
+	template<typename T>
+	static T& writable_slot(PagedTable<T>& table, NodeIdx fid)
+	{
+		const std::size_t idx = static_cast<std::size_t>(fid);
+		std::shared_ptr<TablePage<T>>& page = table[idx / inode_page_size];
+		if (page.use_count() > 1)
+			page = std::make_shared<TablePage<T>>(*page);
+
+		return (*page)[idx % inode_page_size];
+	}
+
+	/* The name index of a directory, made or copied as needed so that it can be changed. */
+	DirEntryMap& writable_children(NodeIdx dir);
+
+	/* Takes a slot off the free list, or grows the table. */
+	NodeIdx alloc_node();
+
+	/* Fills in a new inode and appends it to its parent's children. */
+	void link_node(NodeIdx fid, NodeIdx parent_fid, std::string_view name, const FileMeta& meta, std::shared_ptr<File> file);
+
+	/* Detaches a childless inode from its parent and returns the slot to the free list. */
+	void unlink_node(NodeIdx fid);
+
+	/* Adds an inode to the end of a directory's children, under its current name. */
+	void attach_child(NodeIdx fid, NodeIdx parent_fid);
+
+	/* Removes an inode from its parent's children, leaving the inode itself alone. */
+	void detach_child(NodeIdx fid);
+
+	/* Walks the path one name at a time from the root. */
+	NodeIdx resolve_path(std::string_view path) const;
+
+	/* Removes a file and, with the callback's blessing, everything below it. */
+	bool remove_tree(NodeIdx fid, const FilePath& path, FileRemoverFn& func);
+
+	void collect_files(NodeIdx dir, bool recurse, std::vector<NodeIdx>& out) const;
+
+	/* Records a change to a live file, for the next serialize_changes; 'also' can add Created or Subtree. */
+	void mark_changed(NodeIdx fid, InodeChange also = InodeChange::None);
+
+	/* Records a tombstone for a live file about to be removed or moved away, unless it was never saved. */
+	void mark_removed(NodeIdx fid);
+
+	/* Adds one file (but not its contents) to a snapshot. */
+	void serialize_file(NodeIdx fid, world::FileSystem* to) const;
+
 	const NodeIdx root_{1};
-	NodeIdx fid_counter_{1024};
-	std::unordered_map<NodeIdx, std::shared_ptr<File>> files_ = {};
-	std::unordered_map<NodeIdx, FilePath> fid_to_path_{};
-	std::unordered_map<FilePath, NodeIdx> path_to_fid_{};
-	std::unordered_map<NodeIdx, NodeIdx> roots_{};
-	std::unordered_map<NodeIdx, FileMeta> metadata_{};
-	std::unordered_multimap<NodeIdx, NodeIdx> mappings_{};
+
+	/* Indexed by fid, through pages; slot 0 is never used, so that 0 can mean 'no file'.
+	Free slots are chained through next_sibling. Names are kept apart from inodes, as they are cold. */
+	PagedTable<Inode> inodes_{};
+	PagedTable<InodeEntry> entries_{};
+	std::size_t num_slots_{0};
+	NodeIdx free_head_{0};
+	bool frozen_{false};
+
+	/* Changes since the last save: flags by fid, the fids in the order they were first changed,
+	and the paths removed. A freed slot has its flags cleared, so a stale fid in the list is skipped. */
+	std::vector<InodeChange> change_flags_{};
+	std::vector<NodeIdx> changed_{};
+	std::vector<std::string> tombstones_{};
+
+	/* A direct-mapped cache of whole paths to fids, for hot lookups such as '/bin/*' on every exec.
+	Slots are only trusted if stamped with the current epoch, which moves on whenever a name is removed or moved. */
+	struct DentryCacheSlot
+	{
+		std::string path{};
+		NodeIdx fid{0};
+		uint64_t epoch{0};
+	};
+
+	static constexpr std::size_t dentry_cache_size = 256;
+	mutable std::array<DentryCacheSlot, dentry_cache_size> dentry_cache_{};
+	uint64_t dentry_epoch_{1};
 
 	std::unordered_map<OpenFileHandle, OpenFileTableEntry> open_files_{}; 	
 	OpenFileHandle handle_counter_{0};
 	std::set<OpenFileHandle> free_handles_{};
 
 	friend class Navigator;
-};
\ No newline at end of file
+};
+
+/* The state of a walk lives in the range, so its iterators are just a pointer to it.
+Only the links needed to move on from a yielded file are kept, which is what lets a post-order walk
+carry on after the file is removed. */
+template<typename Filter>
+class FileSystem::Walk
+{
+public:
+
+	struct Sentinel { };
+
+	class Iterator
+	{
+	public:
+
+		using value_type = NodeIdx;
+		using difference_type = std::ptrdiff_t;
+
+		Iterator() = default;
+		explicit Iterator(Walk* walk) : walk_(walk) { }
+
+		NodeIdx operator * () const { return walk_->current_; }
+		Iterator& operator ++ () { walk_->advance(); return *this; }
+		void operator ++ (int) { walk_->advance(); }
+		bool operator == (Sentinel) const { return walk_->current_ == 0; }
+
+	private:
+
+		Walk* walk_{nullptr};
+	};
+
+	Walk(const FileSystem* fs, NodeIdx top, WalkOrder order, Filter filter)
+		: fs_(fs), top_(top), order_(order), filter_(std::move(filter)) { }
+
+	Iterator begin()
+	{
+		const Inode* top = fs_->get_node(top_);
+		InodeLink first = top ? top->first_child : 0;
+
+		if (order_ == WalkOrder::PreOrder)
+			settle_pre(first);
+		else if (first != 0)
+			settle_post(first);
+		else
+			current_ = 0;
+
+		return Iterator{this};
+	}
+
+	Sentinel end() const { return {}; }
+
+private:
+
+	const Inode& node(NodeIdx fid) const { return fs_->inode(fid); }
+
+	WalkStep decide(NodeIdx fid)
+	{
+		if constexpr (std::is_same_v<std::invoke_result_t<Filter&, NodeIdx>, bool>)
+			return filter_(fid) ? WalkStep::Enter : WalkStep::Skip;
+		else
+			return filter_(fid);
+	}
+
+	void yield(NodeIdx fid, bool enter)
+	{
+		current_ = fid;
+		enter_current_ = enter;
+		sibling_ = node(fid).next_sibling;
+		parent_ = node(fid).parent;
+	}
+
+	/* The next file to consider after finishing one, or 0 once back at the top. */
+	InodeLink climb(InodeLink sibling, InodeLink parent) const
+	{
+		while (sibling == 0)
+		{
+			if (parent == top_)
+				return 0;
+
+			sibling = node(parent).next_sibling;
+			parent = node(parent).parent;
+		}
+
+		return sibling;
+	}
+
+	void settle_pre(InodeLink candidate)
+	{
+		while (candidate != 0)
+		{
+			WalkStep step = decide(candidate);
+			if (step != WalkStep::Skip)
+			{
+				yield(candidate, step == WalkStep::Enter);
+				return;
+			}
+
+			candidate = climb(node(candidate).next_sibling, node(candidate).parent);
+		}
+
+		current_ = 0;
+	}
+
+	/* Goes as deep as the filter allows, yielding the first file with nothing left to walk below it.
+	A directory is only yielded once everything it was entered for is done. */
+	void settle_post(InodeLink candidate)
+	{
+		while (true)
+		{
+			WalkStep step = decide(candidate);
+			if (step == WalkStep::Enter && node(candidate).first_child != 0)
+			{
+				candidate = node(candidate).first_child;
+				continue;
+			}
+
+			if (step != WalkStep::Skip)
+			{
+				yield(candidate, false);
+				return;
+			}
+
+			if (node(candidate).next_sibling == 0)
+			{
+				finish_post(0, node(candidate).parent);
+				return;
+			}
+
+			candidate = node(candidate).next_sibling;
+		}
+	}
+
+	void finish_post(InodeLink sibling, InodeLink parent)
+	{
+		if (sibling != 0)
+			settle_post(sibling);
+		else if (parent == top_)
+			current_ = 0;
+		else
+			yield(parent, false);
+	}
+
+	void advance()
+	{
+		if (order_ == WalkOrder::PostOrder)
+		{
+			finish_post(sibling_, parent_);
+			return;
+		}
+
+		InodeLink child = enter_current_ ? node(current_).first_child : 0;
+		settle_pre(child != 0 ? child : climb(sibling_, parent_));
+	}
+
+	const FileSystem* fs_{nullptr};
+	NodeIdx top_{0};
+	WalkOrder order_{WalkOrder::PreOrder};
+	Filter filter_;
+
+	NodeIdx current_{0};
+	InodeLink sibling_{0};
+	InodeLink parent_{0};
+	bool enter_current_{false};
+};
@@ -124,6 +124,7 @@ struct OpenFileTableEntry
 	NodeIdx node{0};
 	int32_t instance_count{0};
 	FileAccessFlags flags{0};
+	std::size_t offset{0};
 };
 
 using OpenFileTablePair = std::pair<OpenFileHandle, OpenFileTableEntry*>;
\ No newline at end of file
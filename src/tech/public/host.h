@@ -6,12 +6,16 @@
 #include <vector>
 #include <string>
 #include <memory>
+#include <filesystem>
+#include <system_error>
 
 namespace world { class Host; }
 
 struct GameServices;
 struct Command;
 
+class RunQueue;
+
 class OS;
 class World;
 class File;
@@ -70,12 +74,22 @@ public:
 
 	void set_os(std::unique_ptr<OS>&& os);
 
+	/* The run queue this host's coroutines resume on. Set by the world when the host is added. */
+	void set_executor(RunQueue* executor) { executor_ = executor; }
+	RunQueue* get_executor() const { return executor_; }
+
 	bool serialize(world::Host* to);
 	bool deserialize(const world::Host& from);
+	bool serialize_changes(world::Host* to);
+
+	/* Save this host's file system as a flat image, or map one back in (see FileSystem::save_image). */
+	std::error_condition save_image(const std::filesystem::path& path) const;
+	std::error_condition load_image(const std::filesystem::path& path);
 
 private:
 	
 	GameServices* services_{nullptr};
+	RunQueue* executor_{nullptr};
 	std::string hostname_ = {};
 	std::unique_ptr<OS> os_{nullptr};
 	std::vector<std::unique_ptr<Device>> devices_{};
@@ -17,6 +17,7 @@
 #include <unordered_map>
 #include <system_error>
 #include <tuple>
+#include <stop_token>
 
 class OS;
 class NIC;
@@ -45,22 +46,26 @@ public:
 	
 	Task<std::expected<OpenSocketPair, std::error_condition>> async_accept_socket(OpenSocketHandle sock);
 
-	Task<NetReadResult> async_read_socket(OpenSocketHandle sock);
-	Task<NetReadResultTcp> async_read_socket_tcp(OpenSocketHandle sock);
-	Task<NetReadResultIp> async_read_socket_raw(OpenSocketHandle sock);
+	/* Reads give up with ECANCELED once a stop is requested on the token. */
+	Task<NetReadResult> async_read_socket(OpenSocketHandle sock, std::stop_token stop = {});
+	Task<NetReadResultTcp> async_read_socket_tcp(OpenSocketHandle sock, std::stop_token stop = {});
+	Task<NetReadResultIp> async_read_socket_raw(OpenSocketHandle sock, std::stop_token stop = {});
 
+	/* Waits out a full tx queue rather than dropping data. Returns the bytes sent, or 0 if the socket closed
+	or the queue stayed full for too long, in which case the connection is closed as well. */
 	Task<size_t> async_write_socket(OpenSocketHandle sock, std::string bytes);
 
 	Task<bool> async_socket_test_alive(OpenSocketHandle sock);
 	
 	int32_t listen(OpenSocketHandle sock);
 
-	void route(ip::IpPackage&& package);
+	/* These queue a package, returning false if it was dropped because the queue (or the receiver's) is full. */
+	[[nodiscard]] bool route(ip::IpPackage&& package);
 
-	void safe_rx(ip::IpPackage&& package);
+	[[nodiscard]] bool safe_rx(ip::IpPackage&& package);
 
-	void send(ip::IpPackage&& package);
-	void send(ip::IpPackage&& package, Uid64 mac);
+	[[nodiscard]] bool send(ip::IpPackage&& package);
+	[[nodiscard]] bool send(ip::IpPackage&& package, Uid64 mac);
 
 	void receive(ip::IpPackage&& package);
 	void receive(ip::IpPackage&& package, const Address6& src_addr, const Address6& dest_addr);
@@ -109,9 +114,10 @@ protected:
 	NIC* nic_{nullptr};
 
 	uint64_t handle_counter_{1};
+	uint64_t socket_serial_counter_{0};
 	std::set<OpenSocketHandle> free_handles_{};
 
-	NetQueue routing_queue_{};
+	NetQueue routing_queue_{net_queue_capacity};
 
 	std::unordered_map<OpenSocketHandle, OpenSocketEntry> sockets_;
 	std::unordered_map<Address6, Uid64> arp_cache_;
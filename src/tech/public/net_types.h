@@ -1,6 +1,7 @@
 #pragma once
 
 #include "msg_queue.h"
+#include "ring_queue.h"
 #include "addr.h"
 #include "uid64.h"
 
@@ -19,8 +20,18 @@ class NIC;
 class NetManager;
 class SocketFile;
 
-using NetQueue = MessageQueue<ip::IpPackage>;
-using NetMessageAwaiter = MessageQueueAwaiter<ip::IpPackage>;
+/* Device and routing queues are bounded; a full queue drops packets like a real interface would.
+Socket queues stay unbounded MessageQueues, since closing a socket broadcasts to every reader. */
+using NetQueue = RingQueue<ip::IpPackage>;
+using NetMessageAwaiter = RingQueueAwaiter<ip::IpPackage>;
+
+/* Every host has several of these, so they are kept short; senders see a full queue through push. */
+constexpr std::size_t net_queue_capacity = 64;
+
+/* Socket data can't be dropped like a bare packet, so a writer facing a full tx queue retries this often,
+for up to this many attempts, before giving up on the connection. */
+constexpr float socket_send_retry_interval = 0.01f;
+constexpr int32_t socket_send_max_attempts = 500;
 
 using OpenSocketHandle = int64_t;
 using OpenSocketPair = std::pair<OpenSocketHandle, struct OpenSocketEntry*>;
@@ -28,8 +39,13 @@ using OpenSocketPair = std::pair<OpenSocketHandle, struct OpenSocketEntry*>;
 struct OpenSocketEntry
 {
 	OpenSocketHandle handle{-1};
+	uint64_t serial{0};		// Unlike the handle, never reused.
 	int32_t instances{0};
 
+	/* Writers waiting on a full tx queue take a ticket, so data still leaves in the order it was written. */
+	uint64_t tx_next_ticket{0};
+	uint64_t tx_serving{0};
+
 	MessageQueue<ip::IpPackage> rx_queue{};
 	MessageQueue<ip::IpPackage> tx_queue{};
 
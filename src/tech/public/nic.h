@@ -34,8 +34,10 @@ public:
 	float get_physical_bandwidth() const { return bandwidth_; }
 	void set_physical_bandwidth(float gbps) { bandwidth_ = gbps; }
 
+	/* Only before the NIC is linked. Linked NICs read each other's address from their own threads
+	(in ARP, see NetManager::arp_request), which is only safe while it never changes. */
 	void set_ip(const std::string& new_ip);
-	void set_ip(const Address6& new_ip) { address_ = new_ip; }
+	void set_ip(const Address6& new_ip);
 	const Address6& get_ip() const { return address_; }
 
 	/* Linkable IF */
@@ -64,7 +66,7 @@ protected:
 	Address6 address_{};
 	float bandwidth_ = 0.f;
 
-	NetQueue rx_queue_{};
-	NetQueue tx_queue_{};
+	NetQueue rx_queue_{net_queue_capacity};
+	NetQueue tx_queue_{net_queue_capacity};
 
 };
\ No newline at end of file
@@ -84,6 +84,8 @@ public:
 
 	Proc* create_process(CreateProcessParams&& params = {});
 	void kill_process(int32_t pid);
+	/* Start a process. It is started on the owning host's executor (if it has one),
+	so that everything it awaits later resumes there, whichever thread calls this. */
 	EagerTask<int32_t> run_process(ProcessFn program, std::vector<std::string> args, CreateProcessParams&& params = {});
 	void get_processes(std::function<void(const Proc&)> reader) const;
 	bool process_is_running(int32_t pid) const;
@@ -125,11 +127,17 @@ public:
 	[[nodiscard]] TimerAwaiter wait(float seconds);
 	void schedule(float seconds, SchedulerFn callback);
 
+	/* A full save, or a load, is the base the next serialize_changes builds on. */
 	bool serialize(world::Host* to);
 	bool deserialize(const world::Host& from);
 
+	/* Like serialize, but with only the file system changes since the last save (see FileSystem::serialize_changes). */
+	bool serialize_changes(world::Host* to);
+
 protected:
 
+	EagerTask<int32_t> run_process_internal(ProcessFn program, std::vector<std::string> args, CreateProcessParams&& params);
+
 	GameServices* services_{nullptr};
 
 	Host& owner_;
@@ -26,6 +26,7 @@
 #include <ostream>
 #include <expected>
 #include <system_error>
+#include <utility>
 
 class Proc;
 class OS;
@@ -118,8 +119,9 @@ public:
     void set_reader(ReaderFn&& reader);
 
 	/* Try to read something from a reader function, if it has been provided. 
-	The data type must be specified and match, or an exception will be raised. */
-	Task<ReadResult> read(EnvVarAccessMode mode = EnvVarAccessMode::Inherit);
+	The data type must be specified and match, or an exception will be raised.
+	Once a stop is requested on the token the result no longer matters, and the read is withdrawn. */
+	Task<ReadResult> read(EnvVarAccessMode mode = EnvVarAccessMode::Inherit, std::stop_token stop = {});
 
 	/* Optionally read with timeout. */
 	Task<ReadResult> read(float timeout, EnvVarAccessMode mode = EnvVarAccessMode::Inherit);
@@ -195,7 +197,11 @@ public:
 	/* --- FUNCTIONS THAT RELATE TO OS --- */
 	[[nodiscard]] Task<std::error_condition> wait(float seconds);
 
-	void add_signal_callback(SignalCallbackFn&& fn);
+	/* Call fn on the next signal. The id can be used to remove it before then. */
+	uint64_t add_signal_callback(SignalCallbackFn&& fn);
+
+	/* Returns false if the callback has already been called (or never existed). */
+	bool remove_signal_callback(uint64_t id);
 
 	void signal(SignalType sig);
 
@@ -256,7 +262,8 @@ protected:
 	ReaderFn reader_{nullptr};
 
 	SignalType signal_{-1};
-	std::vector<SignalCallbackFn> signal_callbacks_;
+	std::vector<std::pair<uint64_t, SignalCallbackFn>> signal_callbacks_;
+	uint64_t signal_callback_counter_{0};
 	
 	std::set<FileDescriptor> returned_descriptors_{};
 	FileDescriptor descriptor_counter_{3};
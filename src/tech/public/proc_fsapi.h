@@ -32,13 +32,17 @@ public:
 	std::error_condition close(FileDescriptor fd);
 	std::expected<size_t, std::error_condition> write(FileDescriptor fd, std::string data) const;
 	std::expected<std::string_view, std::error_condition> read(FileDescriptor fd) const;
+	std::expected<std::string_view, std::error_condition> read(FileDescriptor fd, size_t bytes) const;
+	std::expected<std::string, std::error_condition> pread(FileDescriptor fd, size_t offset, size_t bytes) const;
+	std::expected<size_t, std::error_condition> pwrite(FileDescriptor fd, size_t offset, std::string_view data) const;
 	std::expected<ProcessFn, std::error_condition> read_exe(FileDescriptor fd) const;
-	std::expected<FileMeta*, std::error_condition> get_metadata(FileDescriptor fd) const;
+	std::expected<const FileMeta*, std::error_condition> get_metadata(FileDescriptor fd) const;
 
 	FilePath resolve(FilePath path);
 	std::expected<NodeIdx, std::error_condition> query(const FilePath& path, FileAccessFlags flags);
 	std::error_condition remove(const FilePath& path, bool recurse = false);
 	bool remove_using(const FilePath& path, FileRemoverFn&& func);
+	std::error_condition move(const FilePath& from, const FilePath& to);
 
 	OpenFileHandle get_file_handle(FileDescriptor fd) const;
 	NodeIdx get_node(FileDescriptor fd) const;
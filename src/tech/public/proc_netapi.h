@@ -14,6 +14,7 @@
 #include <expected>
 #include <system_error>
 #include <set>
+#include <stop_token>
 
 class OS;
 class Proc;
@@ -42,9 +43,9 @@ public:
 	
 	Task<DescriptorResult> async_accept_socket(FileDescriptor sock);
 
-	Task<NetReadResult> async_read_socket(FileDescriptor sock) const;
-	Task<NetReadResultTcp> async_read_socket_tcp(FileDescriptor sock) const;
-	Task<NetReadResultIp> async_read_socket_raw(FileDescriptor sock) const;
+	Task<NetReadResult> async_read_socket(FileDescriptor sock, std::stop_token stop = {}) const;
+	Task<NetReadResultTcp> async_read_socket_tcp(FileDescriptor sock, std::stop_token stop = {}) const;
+	Task<NetReadResultIp> async_read_socket_raw(FileDescriptor sock, std::stop_token stop = {}) const;
 
 	Task<size_t> async_write_socket(FileDescriptor sock, std::string bytes) const;
 
@@ -21,9 +21,13 @@ public:
 	void await_suspend(std::coroutine_handle<> h);
 	SignalType await_resume() const { return signal_; }
 
+	/* Stop waiting for a signal; returns false if one has already arrived (or we never suspended). */
+	bool cancel();
+
 protected:
 
 	Proc* proc_{nullptr};
 	SignalType signal_{0};
+	uint64_t callback_id_{0};
 
 };
\ No newline at end of file
@@ -5,6 +5,7 @@
 #include <coroutine>
 #include <system_error>
 #include <expected>
+#include <stop_token>
 
 class Proc;
 
@@ -14,7 +15,9 @@ using ProcessFn = std::function<ProcessTask(Proc&, std::vector<std::string>)>;
 using ReadResult = std::expected<std::string, std::error_condition>;
 
 using WriterFn = std::move_only_function<void(const Proc&, const std::string&)>;
-using ReaderFn = std::move_only_function<Task<ReadResult>(const Proc&)>;
+/* A reader must give up (with any result) once a stop is requested on the token, so that a read
+which lost a race to a signal or timeout doesn't stay queued and take the next message. */
+using ReaderFn = std::move_only_function<Task<ReadResult>(const Proc&, std::stop_token)>;
 using InvokeFn = std::function<void(Proc*)>;
 
 template <class... Ts> struct WriterOverload : Ts... { using Ts::operator()...; };
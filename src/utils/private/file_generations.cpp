@@ -0,0 +1,80 @@
+#include "file_generations.h"
+
+#include <string>
+#include <vector>
+#include <charconv>
+#include <system_error>
+
+namespace
+{
+	/* The generation number in a file name, if the name is a generation of 'path' at all. */
+	std::optional<uint64_t> parse_generation(const std::filesystem::path& path, const std::string& name)
+	{
+		const std::string prefix = path.stem().string() + ".";
+		const std::string suffix = path.extension().string();
+
+		if (name.size() <= prefix.size() + suffix.size() || !name.starts_with(prefix) || !name.ends_with(suffix))
+			return std::nullopt;
+
+		const char* first = name.data() + prefix.size();
+		const char* last = name.data() + name.size() - suffix.size();
+
+		uint64_t gen = 0;
+		auto [ptr, ec] = std::from_chars(first, last, gen);
+		if (ec != std::errc{} || ptr != last)
+			return std::nullopt;
+
+		return gen;
+	}
+
+	template<typename Fn>
+	void for_each_generation(const std::filesystem::path& path, Fn&& fn)
+	{
+		std::error_code ec{};
+		std::filesystem::path dir = path.has_parent_path() ? path.parent_path() : std::filesystem::path{"."};
+
+		for (auto it = std::filesystem::directory_iterator(dir, ec); !ec && it != std::filesystem::directory_iterator{}; it.increment(ec))
+		{
+			if (auto gen = parse_generation(path, it->path().filename().string()))
+				fn(*gen, it->path());
+		}
+	}
+}
+
+std::filesystem::path FileGenerations::get_path(const std::filesystem::path& path, uint64_t gen)
+{
+	std::filesystem::path out = path;
+	out.replace_filename(path.stem().string() + "." + std::to_string(gen) + path.extension().string());
+	return out;
+}
+
+std::optional<std::pair<uint64_t, std::filesystem::path>> FileGenerations::find_latest(const std::filesystem::path& path)
+{
+	std::optional<std::pair<uint64_t, std::filesystem::path>> latest{};
+
+	for_each_generation(path, [&latest](uint64_t gen, const std::filesystem::path& found)
+	{
+		if (!latest || gen > latest->first)
+			latest = { gen, found };
+	});
+
+	return latest;
+}
+
+void FileGenerations::remove_older(const std::filesystem::path& path, uint64_t gen)
+{
+	std::vector<std::filesystem::path> stale{};
+
+	for_each_generation(path, [&](uint64_t found_gen, const std::filesystem::path& found)
+	{
+		if (found_gen < gen)
+			stale.push_back(found);
+	});
+
+	/* Removed after the walk, so the directory isn't changed under the iterator. */
+	for (const std::filesystem::path& old : stale)
+	{
+		std::error_code ec{};
+		std::filesystem::remove_all(old, ec);
+	}
+}
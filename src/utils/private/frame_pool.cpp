@@ -0,0 +1,198 @@
+#include "frame_pool.h"
+
+#include <array>
+#include <atomic>
+#include <mutex>
+#include <vector>
+#include <algorithm>
+#include <new>
+
+namespace
+{
+	constexpr std::size_t granularity = 64;
+	constexpr std::size_t num_classes = 16;
+	constexpr std::size_t max_cached = 256;		// Per size class and thread.
+
+	std::size_t size_class(std::size_t size)
+	{
+		return (size + granularity - 1) / granularity - 1;
+	}
+
+	struct FreeBlock
+	{
+		FreeBlock* next{nullptr};
+	};
+
+	struct FreeList
+	{
+		FreeBlock* head{nullptr};
+		std::size_t count{0};
+	};
+
+	/* Only ever written by their own thread, so counting is a plain store; get_stats reads them from outside. */
+	struct ThreadCounts
+	{
+		std::atomic<std::size_t> allocated{0};
+		std::atomic<std::size_t> released{0};
+	};
+
+	/* Counts of live threads, and what exited threads left behind. Only touched at thread start and exit, and by get_stats. */
+	std::mutex registry_lock{};
+	std::vector<const ThreadCounts*> registry{};
+	std::size_t retired_allocated = 0;
+	std::size_t retired_released = 0;
+
+	/* Frames handled after a thread's cache is gone (during its exit); rare enough to share. */
+	std::atomic<std::size_t> late_allocated{0};
+	std::atomic<std::size_t> late_released{0};
+
+	std::atomic<std::size_t> peak_live{0};
+	std::atomic<FramePool::FrameHookFn> frame_hook{nullptr};
+
+	/* Set once the cache of this thread is gone, so frames freed during thread exit bypass it. */
+	thread_local bool cache_destroyed = false;
+
+	struct ThreadCache
+	{
+		std::array<FreeList, num_classes> lists{};
+		ThreadCounts counts{};
+
+		ThreadCache()
+		{
+			std::lock_guard lock(registry_lock);
+			registry.push_back(&counts);
+		}
+
+		~ThreadCache()
+		{
+			for (std::size_t cls = 0; cls < num_classes; ++cls)
+			{
+				while (FreeBlock* block = lists[cls].head)
+				{
+					lists[cls].head = block->next;
+					::operator delete(block, (cls + 1) * granularity);
+				}
+			}
+
+			/* Scoped lock */
+			{
+				std::lock_guard lock(registry_lock);
+				retired_allocated += counts.allocated.load(std::memory_order_relaxed);
+				retired_released += counts.released.load(std::memory_order_relaxed);
+				std::erase(registry, &counts);
+			}
+
+			cache_destroyed = true;
+		}
+	};
+
+	thread_local ThreadCache cache{};
+
+	void bump(std::atomic<std::size_t>& counter)
+	{
+		counter.store(counter.load(std::memory_order_relaxed) + 1, std::memory_order_relaxed);
+	}
+
+	void count_allocated(void* ptr, std::size_t size)
+	{
+		if (cache_destroyed)
+			late_allocated.fetch_add(1, std::memory_order_relaxed);
+		else
+			bump(cache.counts.allocated);
+
+		if (auto hook = frame_hook.load(std::memory_order_acquire))
+			hook(ptr, size, true);
+	}
+
+	void count_released(void* ptr, std::size_t size)
+	{
+		if (cache_destroyed)
+			late_released.fetch_add(1, std::memory_order_relaxed);
+		else
+			bump(cache.counts.released);
+
+		if (auto hook = frame_hook.load(std::memory_order_acquire))
+			hook(ptr, size, false);
+	}
+
+	void* allocate_block(std::size_t size)
+	{
+		const std::size_t cls = size_class(size);
+
+		if (cls >= num_classes || cache_destroyed)
+			return ::operator new(cls >= num_classes ? size : (cls + 1) * granularity);
+
+		FreeList& list = cache.lists[cls];
+		if (FreeBlock* block = list.head)
+		{
+			list.head = block->next;
+			--list.count;
+			return block;
+		}
+
+		return ::operator new((cls + 1) * granularity);
+	}
+}
+
+void* FramePool::allocate(std::size_t size)
+{
+	void* ptr = allocate_block(size);
+	count_allocated(ptr, size);
+	return ptr;
+}
+
+void FramePool::deallocate(void* ptr, std::size_t size) noexcept
+{
+	count_released(ptr, size);
+
+	const std::size_t cls = size_class(size);
+
+	if (cls >= num_classes)
+	{
+		::operator delete(ptr, size);
+		return;
+	}
+
+	if (cache_destroyed || cache.lists[cls].count >= max_cached)
+	{
+		::operator delete(ptr, (cls + 1) * granularity);
+		return;
+	}
+
+	FreeList& list = cache.lists[cls];
+	list.head = ::new (ptr) FreeBlock{list.head};
+	++list.count;
+}
+
+FramePool::FrameStats FramePool::get_stats()
+{
+	std::size_t allocated = late_allocated.load(std::memory_order_relaxed);
+	std::size_t released = late_released.load(std::memory_order_relaxed);
+
+	/* Scoped lock */
+	{
+		std::lock_guard lock(registry_lock);
+
+		allocated += retired_allocated;
+		released += retired_released;
+
+		for (const ThreadCounts* counts : registry)
+		{
+			allocated += counts->allocated.load(std::memory_order_relaxed);
+			released += counts->released.load(std::memory_order_relaxed);
+		}
+	}
+
+	/* The threads are read one after another, so a frame freed elsewhere may be seen released before allocated. */
+	std::size_t live = (allocated > released) ? allocated - released : 0;
+
+	std::size_t peak = peak_live.load(std::memory_order_relaxed);
+	while (live > peak && !peak_live.compare_exchange_weak(peak, live, std::memory_order_relaxed)) {}
+
+	return { live, std::max(peak, live), allocated };
+}
+
+void FramePool::set_frame_hook(FrameHookFn fn)
+{
+	frame_hook.store(fn, std::memory_order_release);
+}
@@ -0,0 +1,102 @@
+#include "mapped_file.h"
+
+#ifdef _WIN32
+#define WIN32_LEAN_AND_MEAN
+#define NOMINMAX
+#include <windows.h>
+#else
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <cerrno>
+#endif
+
+std::expected<std::shared_ptr<const MappedFile>, std::error_condition> MappedFile::open(const std::filesystem::path& path)
+{
+	std::shared_ptr<MappedFile> out{new MappedFile()};
+
+#ifdef _WIN32
+
+	/* Sharing delete lets older generations be cleaned up (see FileGenerations) once they are unmapped. */
+	HANDLE file = CreateFileW(path.c_str(), GENERIC_READ, FILE_SHARE_READ | FILE_SHARE_DELETE, nullptr, OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, nullptr);
+	if (file == INVALID_HANDLE_VALUE)
+		return std::unexpected(std::error_condition{ENOENT, std::generic_category()});
+
+	out->file_handle_ = file;
+
+	LARGE_INTEGER size{};
+	if (!GetFileSizeEx(file, &size))
+		return std::unexpected(std::error_condition{EIO, std::generic_category()});
+
+	out->size_ = static_cast<std::size_t>(size.QuadPart);
+
+	/* An empty file can't be mapped, but is a valid (empty) view. */
+	if (out->size_ == 0)
+		return out;
+
+	HANDLE mapping = CreateFileMappingW(file, nullptr, PAGE_READONLY, 0, 0, nullptr);
+	if (mapping == nullptr)
+		return std::unexpected(std::error_condition{EIO, std::generic_category()});
+
+	out->mapping_handle_ = mapping;
+	out->data_ = MapViewOfFile(mapping, FILE_MAP_READ, 0, 0, 0);
+
+	if (out->data_ == nullptr)
+		return std::unexpected(std::error_condition{EIO, std::generic_category()});
+
+#else
+
+	int fd = ::open(path.c_str(), O_RDONLY);
+	if (fd < 0)
+		return std::unexpected(std::error_condition{errno, std::generic_category()});
+
+	struct stat st{};
+	if (fstat(fd, &st) != 0)
+	{
+		::close(fd);
+		return std::unexpected(std::error_condition{errno, std::generic_category()});
+	}
+
+	out->size_ = static_cast<std::size_t>(st.st_size);
+
+	if (out->size_ > 0)
+	{
+		void* data = mmap(nullptr, out->size_, PROT_READ, MAP_PRIVATE, fd, 0);
+		if (data == MAP_FAILED)
+		{
+			::close(fd);
+			return std::unexpected(std::error_condition{errno, std::generic_category()});
+		}
+
+		out->data_ = data;
+	}
+
+	/* The mapping keeps the file alive on its own. */
+	::close(fd);
+
+#endif
+
+	return out;
+}
+
+MappedFile::~MappedFile()
+{
+#ifdef _WIN32
+
+	if (data_)
+		UnmapViewOfFile(data_);
+
+	if (mapping_handle_)
+		CloseHandle(mapping_handle_);
+
+	if (file_handle_)
+		CloseHandle(file_handle_);
+
+#else
+
+	if (data_)
+		munmap(const_cast<void*>(data_), size_);
+
+#endif
+}
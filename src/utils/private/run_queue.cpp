@@ -0,0 +1,83 @@
+#include "run_queue.h"
+
+#include <utility>
+
+namespace
+{
+	thread_local RunQueue* current_run_queue = nullptr;
+}
+
+void RunQueue::post(std::coroutine_handle<> h)
+{
+	/* Scoped lock */
+	{
+		std::lock_guard<std::mutex> lock(mutex_);
+		ready_.push_back({ h, Clock::now() });
+	}
+
+	if (on_post_ && current_run_queue != this)
+		on_post_();
+}
+
+std::size_t RunQueue::run()
+{
+	using namespace std::chrono;
+
+	/* Scoped lock */
+	{
+		std::lock_guard<std::mutex> lock(mutex_);
+		std::swap(ready_, running_);
+	}
+
+	const std::size_t count = running_.size();
+	if (count == 0)
+		return 0;
+
+	if (count > stats_.peak_depth.load(std::memory_order_relaxed))
+		stats_.peak_depth.store(count, std::memory_order_relaxed);
+
+	uint64_t total_us = 0;
+	for (const Entry& entry : running_)
+	{
+		uint64_t us = duration_cast<microseconds>(Clock::now() - entry.posted).count();
+		total_us += us;
+
+		stats_.last_latency_us.store(us, std::memory_order_relaxed);
+		if (us > stats_.peak_latency_us.load(std::memory_order_relaxed))
+			stats_.peak_latency_us.store(us, std::memory_order_relaxed);
+
+		entry.handle.resume();
+	}
+
+	running_.clear();
+
+	stats_.resumed.fetch_add(count, std::memory_order_relaxed);
+	stats_.total_latency_us.fetch_add(total_us, std::memory_order_relaxed);
+
+	return count;
+}
+
+bool RunQueue::empty() const
+{
+	std::lock_guard<std::mutex> lock(mutex_);
+	return ready_.empty();
+}
+
+std::size_t RunQueue::size() const
+{
+	std::lock_guard<std::mutex> lock(mutex_);
+	return ready_.size();
+}
+
+RunQueue* RunQueue::current()
+{
+	return current_run_queue;
+}
+
+RunQueue::Scope::Scope(RunQueue& queue)
+	: prev_(std::exchange(current_run_queue, &queue)) { }
+
+RunQueue::Scope::~Scope()
+{
+	current_run_queue = prev_;
+}
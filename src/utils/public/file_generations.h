@@ -0,0 +1,23 @@
+#pragma once
+
+#include <cstdint>
+#include <utility>
+#include <optional>
+#include <filesystem>
+
+/* Files that stay mapped while in use (file system images, world snapshots) can't be replaced in place
+on Windows, where a mapped file can be neither overwritten nor renamed over. They are saved as numbered
+generations side by side instead ('world.2.snap' after 'world.1.snap'), read back from the newest,
+and older generations are removed once nothing maps them any more. */
+namespace FileGenerations
+{
+	/* Generation 'gen' of 'path': the number goes between the stem and the extension. */
+	std::filesystem::path get_path(const std::filesystem::path& path, uint64_t gen);
+
+	/* The newest generation of 'path' on disk, and its number. */
+	std::optional<std::pair<uint64_t, std::filesystem::path>> find_latest(const std::filesystem::path& path);
+
+	/* Removes every generation of 'path' older than 'gen', whether file or directory.
+	Those still mapped somewhere (on Windows) can't be removed yet, and are left for a later call. */
+	void remove_older(const std::filesystem::path& path, uint64_t gen);
+}
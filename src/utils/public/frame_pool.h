@@ -0,0 +1,30 @@
+#pragma once
+
+#include <cstddef>
+
+/* Thread-local free lists for coroutine frames, in size classes of 64 bytes up to 1 KiB.
+Frames are usually freed on the thread that allocated them; if not, the block simply joins
+the freeing thread's list. Larger frames go straight to the global allocator. */
+namespace FramePool
+{
+	/* Process-wide frame counters. A live count that keeps climbing points to leaked frames.
+	Each thread counts its own frames and these are summed when asked for, so peak_live is
+	the highest live count seen by get_stats rather than the exact peak. */
+	struct FrameStats
+	{
+		std::size_t live{0};
+		std::size_t peak_live{0};
+		std::size_t total{0};
+	};
+
+	/* Called on every frame allocation (with allocated = true) and release, from the thread doing it. */
+	using FrameHookFn = void(*)(void* frame, std::size_t size, bool allocated);
+
+	void* allocate(std::size_t size);
+	void deallocate(void* ptr, std::size_t size) noexcept;
+
+	FrameStats get_stats();
+
+	/* Install an instrumentation hook, or nullptr to remove it. */
+	void set_frame_hook(FrameHookFn fn);
+}
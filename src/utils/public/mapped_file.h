@@ -0,0 +1,37 @@
+#pragma once
+
+#include <cstddef>
+#include <memory>
+#include <string_view>
+#include <filesystem>
+#include <expected>
+#include <system_error>
+
+/* A read-only view of a whole file, mapped into memory.
+The OS pages it in on demand and may drop clean pages under pressure,
+so a mapping nobody touches costs page cache rather than heap. */
+class MappedFile
+{
+public:
+
+	static std::expected<std::shared_ptr<const MappedFile>, std::error_condition> open(const std::filesystem::path& path);
+
+	MappedFile(const MappedFile&) = delete;
+	MappedFile& operator = (const MappedFile&) = delete;
+
+	~MappedFile();
+
+	std::string_view view() const { return { static_cast<const char*>(data_), size_ }; }
+	std::size_t size() const { return size_; }
+
+private:
+
+	MappedFile() = default;
+
+	const void* data_{nullptr};
+	std::size_t size_{0};
+
+	/* The platform's file and mapping handles. */
+	void* file_handle_{nullptr};
+	void* mapping_handle_{nullptr};
+};
@@ -5,19 +5,20 @@
 #include <string>
 #include <optional>
 #include <functional>
+#include <utility>
 #include <coroutine>
+#include <stop_token>
 #include <ranges>
 #include <algorithm>
 
-template<typename T>
-using MessageCallbackFn = std::function<void(const T&)>;
-
-template<typename T>
-using MessageCallbackList = std::vector<MessageCallbackFn<T>>;
+#include "run_queue.h"
 
 template<typename T>
 struct MessageQueueAwaiter;
 
+/* A mutex-guarded message queue that coroutines can await.
+Each pushed message goes to exactly one consumer: the longest-waiting awaiter if there is one,
+otherwise the back of the queue. Several coroutines awaiting one queue therefore share its work. */
 template<typename T>
 class MessageQueue 
 {
@@ -27,22 +28,29 @@ public:
 
     ~MessageQueue()
     {
-        broadcast_clear(T{});
+        release_waiters([] { return T{}; });
     }
 
     void push(T&& message) 
 	{
+        MessageQueueAwaiter<T>* waiter = nullptr;
+
         /* Scoped lock */
         {
             std::lock_guard<std::mutex> lock(mutex_);
-            if (callbacks_.empty())
+
+            if (!waiters_head_)
             {
-                queue_.emplace_back(std::forward<T>(message));
+                queue_.emplace_back(std::move(message));
                 return;
             }
+
+            waiter = pop_waiter();
+            waiter->next_.emplace(std::move(message));
         }
-        
-        broadcast_clear(std::forward<T>(message));
+
+        /* Resumed outside the lock, as the waiter may well push or pop again. */
+        resume_on(waiter->executor_, waiter->handle_);
     }
 
     std::optional<T> pop() 
@@ -52,7 +60,7 @@ public:
         if (queue_.empty())
 			return std::nullopt;
 
-        T msg = queue_.front();
+        T msg = std::move(queue_.front());
         queue_.pop_front();
 
 		return msg;
@@ -73,55 +81,136 @@ public:
         return MessageQueueAwaiter<T>(this);
     }
 
+    /* As above, but gives up waiting once a stop is requested on the token; the awaiter then
+    unregisters itself and resumes with a default-constructed message, as on queue destruction. */
+    MessageQueueAwaiter<T> async_pop(std::stop_token stop)
+    {
+        return MessageQueueAwaiter<T>(this, std::move(stop));
+    }
+
     bool empty() const
     {
         std::lock_guard<std::mutex> lock(mutex_);
         return queue_.empty();
     }
 
+    std::size_t size() const
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        return queue_.size();
+    }
+
     std::deque<T> copy()
     {
         std::lock_guard<std::mutex> lock(mutex_);
         return std::deque<T>(queue_);
     }
 
+    /* Takes every pending message in a single lock acquisition,
+    leaving the queue empty. The batch is swapped out, not copied. */
     std::deque<T> copy_clear()
     {
+        std::deque<T> batch{};
         std::lock_guard<std::mutex> lock(mutex_);
-        std::deque<T> copy = std::deque<T>(queue_);
-        std::deque<T> empty{};
-        std::swap(queue_, empty);
-        return copy;
+        std::swap(queue_, batch);
+        return batch;
     }
 
-    void add_awaiter(MessageCallbackFn<T>&& callback)
+    /* Give every current waiter its own copy of a message (eg. a connection closing),
+    unlike push, which hands a message to a single waiter. Queued messages are left alone. */
+    void broadcast_clear(T&& message)
+    {
+        T local_message = std::move(message);
+        release_waiters([&local_message] { return local_message; });
+    }
+
+private:
+
+    friend struct MessageQueueAwaiter<T>;
+
+    /* Called by a suspending awaiter. If a message arrived since await_ready,
+    it is taken directly and the awaiter doesn't suspend. */
+    bool suspend_waiter(MessageQueueAwaiter<T>* waiter)
     {
         std::lock_guard<std::mutex> lock(mutex_);
-        callbacks_.push_back(std::move(callback));
+
+        if (!queue_.empty())
+        {
+            waiter->next_.emplace(std::move(queue_.front()));
+            queue_.pop_front();
+            return false;
+        }
+
+        if (waiters_tail_)
+            waiters_tail_->next_waiter_ = waiter;
+        else
+            waiters_head_ = waiter;
+
+        waiters_tail_ = waiter;
+        return true;
     }
 
-    void broadcast_clear(const T&& message)
+    bool cancel_waiter(MessageQueueAwaiter<T>* waiter)
     {
-        MessageCallbackList<T> empty{};
-        T local_message = std::move(message);
+        std::lock_guard<std::mutex> lock(mutex_);
+
+        MessageQueueAwaiter<T>* prev = nullptr;
+        for (MessageQueueAwaiter<T>* it = waiters_head_; it; prev = it, it = it->next_waiter_)
+        {
+            if (it != waiter)
+                continue;
+
+            (prev ? prev->next_waiter_ : waiters_head_) = it->next_waiter_;
+            if (waiters_tail_ == it)
+                waiters_tail_ = prev;
+
+            it->next_waiter_ = nullptr;
+            return true;
+        }
+
+        return false;
+    }
+
+    template<typename MakeFn>
+    void release_waiters(MakeFn&& make)
+    {
+        MessageQueueAwaiter<T>* waiters = nullptr;
         {
             std::scoped_lock<std::mutex> lock(mutex_);
 
-            /* In this critical section, we swap the callbacks array
-            to the empty one, before we actually iterate over anything.
-            When we iterate, the mutex is unlocked, as we now own all
-            resources locally within this stack. */
-            
-            std::swap(callbacks_, empty);
+            /* In this critical section, we detach the whole waiter list
+            before we actually iterate over anything. When we iterate,
+            the mutex is unlocked, as we now own all waiters locally. */
+
+            waiters = std::exchange(waiters_head_, nullptr);
+            waiters_tail_ = nullptr;
+        }
+
+        while (waiters)
+        {
+            MessageQueueAwaiter<T>* waiter = waiters;
+            waiters = std::exchange(waiter->next_waiter_, nullptr);
+            waiter->next_.emplace(make());
+            resume_on(waiter->executor_, waiter->handle_);
         }
-        for (auto& fn : empty) { fn(local_message); }
     }
 
-private:
+    MessageQueueAwaiter<T>* pop_waiter()
+    {
+        MessageQueueAwaiter<T>* waiter = waiters_head_;
+        waiters_head_ = std::exchange(waiter->next_waiter_, nullptr);
+        if (!waiters_head_)
+            waiters_tail_ = nullptr;
+
+        return waiter;
+    }
 
     std::deque<T> queue_{};
     mutable std::mutex mutex_{};
-    MessageCallbackList<T> callbacks_{};
+
+    /* Suspended awaiters, oldest first. The nodes live in the awaiting coroutine frames. */
+    MessageQueueAwaiter<T>* waiters_head_{nullptr};
+    MessageQueueAwaiter<T>* waiters_tail_{nullptr};
 
 };
 
@@ -131,34 +220,91 @@ struct MessageQueueAwaiter
 {
 	using OwningQueue = MessageQueue<T>;
 
-	explicit MessageQueueAwaiter(OwningQueue* owner)
-		: owner_(owner) { }
+	explicit MessageQueueAwaiter(OwningQueue* owner, std::stop_token stop = {})
+		: owner_(owner), stop_(std::move(stop)) { }
 
     MessageQueueAwaiter(MessageQueueAwaiter&) = delete;
 
+    /* Only valid before the awaiter has suspended (eg. when handed to when_any). */
+    MessageQueueAwaiter(MessageQueueAwaiter&& other)
+        : owner_(other.owner_), stop_(std::move(other.stop_)) { }
+
 	bool await_ready()
 	{
 		next_ = owner_->pop();
 		return next_.has_value();
 	}
 
-	void await_suspend(std::coroutine_handle<> h)
+	bool await_suspend(std::coroutine_handle<> h)
 	{
-        owner_->add_awaiter([this, h](const T& msg)
-        {
-            next_ = msg;
-            h.resume();
-        });
+		handle_ = h;
+		executor_ = RunQueue::current();
+
+		if (!stop_.stop_possible())
+			return owner_->suspend_waiter(this);
+
+		if (stop_.stop_requested())
+		{
+			next_.emplace();
+			return false;
+		}
+
+		/* The callback is registered before the waiter is, since once queued this
+		awaiter may be resumed (and destroyed) by another thread at any moment.
+		A stop requested in between is caught by the re-check after queueing. */
+		OwningQueue* owner = owner_;
+		std::stop_token stop = stop_;
+		stop_callback_.emplace(stop_, StopWaiter{this});
+
+		if (!owner->suspend_waiter(this))
+			return false;
+
+		if (stop.stop_requested() && owner->cancel_waiter(this))
+		{
+			next_.emplace();
+			return false;
+		}
+
+		return true;
 	}
 
-	T await_resume() const
+	T await_resume()
 	{
-		return next_.value();
+		stop_callback_.reset();
+		return std::move(next_).value();
+	}
+
+	/* Stop waiting; returns false if a message has already been handed over. */
+	bool cancel()
+	{
+		return owner_->cancel_waiter(this);
 	}
 
 private:
 
+	friend class MessageQueue<T>;
+
+	struct StopWaiter
+	{
+		MessageQueueAwaiter* self{nullptr};
+
+		void operator()() const noexcept
+		{
+			/* If a message was handed over first, the pusher resumes the waiter instead. */
+			if (self->owner_->cancel_waiter(self))
+			{
+				self->next_.emplace();
+				resume_on(self->executor_, self->handle_);
+			}
+		}
+	};
+
     OwningQueue* owner_{nullptr};
+	std::stop_token stop_{};
+	std::optional<std::stop_callback<StopWaiter>> stop_callback_{};
 	std::optional<T> next_{};
+	std::coroutine_handle<> handle_{};
+	RunQueue* executor_{nullptr};
+	MessageQueueAwaiter* next_waiter_{nullptr};
 
 };
\ No newline at end of file
@@ -2,10 +2,19 @@
 
 #include <coroutine>
 #include <atomic>
+#include <array>
 #include <tuple>
+#include <memory>
 #include <exception>
 #include <utility>
 #include <variant>
+#include <concepts>
+#include <optional>
+#include <vector>
+#include <stop_token>
+
+#include "run_queue.h"
+#include "frame_pool.h"
 
 struct void_value {};
 
@@ -14,7 +23,7 @@ using normalize_void =
     std::conditional_t<std::is_void_v<T>, void_value, T>;
 
 template<typename... Results>
-struct when_any_result 
+struct when_any_result
 {
     size_t index;
     std::variant<std::monostate, Results...> value;
@@ -24,57 +33,101 @@ template<typename A>
 using await_result_t =
     decltype(std::declval<A>().await_resume());
 
+/* An awaitable that can be withdrawn while suspended. cancel() returns true only if
+the awaiting coroutine is then guaranteed never to be resumed by it. */
+template<typename A>
+concept cancellable_awaitable = requires(A& a)
+{
+    { a.cancel() } -> std::convertible_to<bool>;
+};
+
+template<typename... Ts>
+concept no_stop_source = (!(std::same_as<std::remove_cvref_t<Ts>, std::stop_source> || ...));
+
+/* The frame each combinator branch runs in. It starts eagerly and frees itself on completion. */
+struct detached_task
+{
+    struct promise_type
+    {
+        static void* operator new(std::size_t size) { return FramePool::allocate(size); }
+        static void operator delete(void* ptr, std::size_t size) noexcept { FramePool::deallocate(ptr, size); }
+
+        detached_task get_return_object()
+        {
+            return { std::coroutine_handle<promise_type>::from_promise(*this) };
+        }
+
+        std::suspend_never initial_suspend() noexcept { return {}; }
+        std::suspend_never final_suspend() noexcept { return {}; }
+
+        void return_void() noexcept {}
+        void unhandled_exception() { std::terminate(); }
+    };
+
+    std::coroutine_handle<> handle;
+};
+
+/* Who owns a when_any branch once the race is decided. A canceller claims the branch
+(Running to Cancelling) before touching its awaitable, and its runner claims it (to Done)
+before touching the shared state, so the two never use the branch's frame at once. */
+enum class BranchState : uint8_t
+{
+    Running,
+    Cancelling,     // A canceller is using the awaitable; the runner must wait.
+    Released,       // The cancel failed; the runner may go on.
+    Done            // The runner is past its co_await and its frame may be gone.
+};
+
 template<typename... Awaitables>
-class when_any_awaitable 
+class when_any_awaitable
 {
 public:
 
-    explicit when_any_awaitable(Awaitables&&... aw)
-        : awaitables(std::forward<Awaitables>(aw)...) {}
+    static constexpr size_t num_branches = sizeof...(Awaitables);
+
+    /* A stop is requested on 'stop' once the race is decided, so that losing branches
+    which were handed its token can wind down on their own. */
+    explicit when_any_awaitable(std::stop_source stop, Awaitables&&... aw)
+        : awaitables(std::forward<Awaitables>(aw)...), stop(std::move(stop)) {}
 
 	template<typename... Results>
-    struct shared_state 
+    struct shared_state
 	{
         std::atomic<bool> completed{false};
+        std::atomic<uint8_t> arrivals{0};
         std::coroutine_handle<> continuation;
+        RunQueue* executor{nullptr};
         std::exception_ptr exception;
 
         size_t winner = static_cast<size_t>(-1);
 		std::variant<std::monostate, Results...> result;
+
+        std::array<std::atomic<BranchState>, sizeof...(Results)> branches{};
     };
 
 	using state_type =
     	shared_state<normalize_void<await_result_t<Awaitables>>...>;
 
-	struct detached_task
-	{
-		struct promise_type
-		{
-			detached_task get_return_object()
-			{
-				return {};
-			}
-
-			std::suspend_never initial_suspend() noexcept { return {}; }
-			std::suspend_never final_suspend() noexcept { return {}; }
-
-			void return_void() noexcept {}
-			void unhandled_exception() { std::terminate(); }
-		};
-	};
-
     bool await_ready() noexcept { return false; }
 
-    void await_suspend(std::coroutine_handle<> h) 
+    bool await_suspend(std::coroutine_handle<> h)
 	{
         state = std::make_shared<state_type>();
         state->continuation = h;
+        state->executor = RunQueue::current();
 
         start_all(std::index_sequence_for<Awaitables...>{});
+
+        /* The winner and this function both 'arrive' once; whichever comes second resumes.
+        If a branch already won while starting, don't suspend at all. */
+        return state->arrivals.fetch_add(1) == 0;
     }
 
-    auto await_resume() 
+    auto await_resume()
 	{
+        cancel_all(std::index_sequence_for<Awaitables...>{});
+        stop.request_stop();
+
         if (state->exception)
             std::rethrow_exception(state->exception);
 
@@ -89,6 +142,11 @@ private:
 
     std::tuple<Awaitables...> awaitables;
     std::shared_ptr<state_type> state;
+    std::stop_source stop;
+
+    /* Each branch runs in its own frame, which owns the awaitable. */
+    std::array<std::coroutine_handle<>, num_branches> runners{};
+    std::tuple<std::add_pointer_t<std::remove_reference_t<Awaitables>>...> running{};
 
     template<size_t... I>
     void start_all(std::index_sequence<I...>)
@@ -99,49 +157,323 @@ private:
     template<size_t Index>
     void start_one()
 	{
-        auto& aw = std::get<Index>(awaitables);
-        run_one<Index>(aw);
+        /* Don't start branches after one has already completed synchronously. */
+        if (state->completed.load())
+            return;
+
+        using Awaitable = std::tuple_element_t<Index, std::tuple<Awaitables...>>;
+        auto& slot = std::get<Index>(running);
+        runners[Index] = run_one<Index, Awaitable>(std::forward<Awaitable>(std::get<Index>(awaitables)), state, &slot).handle;
+    }
+
+    /* Withdraw every branch that lost and is still suspended. Branches whose awaitable can be
+    cancelled have their frames destroyed here; the rest are left to finish (and free themselves). */
+    template<size_t... I>
+    void cancel_all(std::index_sequence<I...>)
+    {
+        (cancel_one<I>(), ...);
+    }
+
+    template<size_t Index>
+    void cancel_one()
+    {
+        using Awaitable = std::remove_reference_t<std::tuple_element_t<Index, std::tuple<Awaitables...>>>;
+
+        if (Index == state->winner || !runners[Index])
+            return;
+
+        if constexpr (cancellable_awaitable<Awaitable>)
+        {
+            /* A branch that is finishing (maybe on another thread) is left to it. */
+            std::atomic<BranchState>& branch = state->branches[Index];
+            BranchState expected = BranchState::Running;
+            if (!branch.compare_exchange_strong(expected, BranchState::Cancelling))
+                return;
+
+            if (std::get<Index>(running)->cancel())
+            {
+                runners[Index].destroy();
+                runners[Index] = nullptr;
+                return;
+            }
+
+            branch.store(BranchState::Released);
+            branch.notify_all();
+        }
+    }
+
+    /* Taken by a branch's runner once its co_await returns, before anything else.
+    If a cancel is under way it is using the awaitable in this frame, so wait for it to let go. */
+    static void claim(std::atomic<BranchState>& branch)
+    {
+        for (;;)
+        {
+            BranchState current = branch.load();
+            if (current == BranchState::Done)
+                return;
+
+            if (current == BranchState::Cancelling)
+            {
+                branch.wait(current);
+                continue;
+            }
+
+            if (branch.compare_exchange_weak(current, BranchState::Done))
+                return;
+        }
     }
 
     template<size_t Index, typename Awaitable>
-    void run_one(Awaitable& aw) 
+    static detached_task run_one(Awaitable aw, std::shared_ptr<state_type> state, std::add_pointer_t<std::remove_reference_t<Awaitable>>* slot)
 	{
-        auto runner = [&aw](std::shared_ptr<state_type> local_state) -> Task<bool>
-		{
-            auto state_copy = std::move(local_state);
-
-            try 
-			{
-                auto value = co_await aw;
-
-                if (!state_copy->completed.exchange(true))
-				{
-                    state_copy->winner = Index;
-					state_copy->result.template emplace<Index + 1>(std::move(value));
-                    state_copy->continuation.resume();
-                }
-
-            } 
-			catch (...) 
-			{
-
-                if (!state_copy->completed.exchange(true))
-				{
-                    state_copy->exception = std::current_exception();
-                    state_copy->winner = Index;
-                    state_copy->continuation.resume();
-                }
+        *slot = &aw;
+
+        try
+        {
+            auto value = co_await aw;
+            claim(state->branches[Index]);
+
+            if (!state->completed.exchange(true))
+            {
+                state->winner = Index;
+                state->result.template emplace<Index + 1>(std::move(value));
+
+                if (state->arrivals.fetch_add(1) == 1)
+                    resume_on(state->executor, state->continuation);
+            }
+        }
+        catch (...)
+        {
+            claim(state->branches[Index]);
+
+            if (!state->completed.exchange(true))
+            {
+                state->exception = std::current_exception();
+                state->winner = Index;
+
+                if (state->arrivals.fetch_add(1) == 1)
+                    resume_on(state->executor, state->continuation);
+            }
+        }
+    }
+};
+
+template<typename... Awaitables>
+    requires no_stop_source<Awaitables...>
+auto when_any(Awaitables&&... aw)
+{
+    return when_any_awaitable<Awaitables...>(std::stop_source{std::nostopstate}, std::forward<Awaitables>(aw)...);
+}
+
+template<typename... Awaitables>
+auto when_any(std::stop_source stop, Awaitables&&... aw)
+{
+    return when_any_awaitable<Awaitables...>(std::move(stop), std::forward<Awaitables>(aw)...);
+}
+
+/* Awaits every branch and gives back all results, in order. Branches run concurrently.
+All branches finish before the awaiting coroutine resumes, so the shared state lives in the awaitable.
+If a branch throws, a stop is requested on 'stop' and the first exception is rethrown once the rest are done. */
+template<typename... Awaitables>
+class when_all_awaitable
+{
+public:
+
+    static constexpr size_t num_branches = sizeof...(Awaitables);
+
+    using result_type = std::tuple<normalize_void<await_result_t<Awaitables>>...>;
+
+    explicit when_all_awaitable(std::stop_source stop, Awaitables&&... aw)
+        : awaitables(std::forward<Awaitables>(aw)...), stop(std::move(stop)) {}
+
+    when_all_awaitable(const when_all_awaitable&) = delete;
+    when_all_awaitable& operator = (const when_all_awaitable&) = delete;
+
+    bool await_ready() noexcept { return num_branches == 0; }
+
+    bool await_suspend(std::coroutine_handle<> h)
+    {
+        continuation = h;
+        executor = RunQueue::current();
+
+        start_all(std::index_sequence_for<Awaitables...>{});
+
+        /* Every branch and this function count down once; the last one resumes. */
+        return pending.fetch_sub(1) != 1;
+    }
+
+    result_type await_resume()
+    {
+        if (exception)
+            std::rethrow_exception(exception);
+
+        return std::apply([](auto&... result) { return result_type{std::move(*result)...}; }, results);
+    }
+
+private:
+
+    std::tuple<Awaitables...> awaitables;
+    std::tuple<std::optional<normalize_void<await_result_t<Awaitables>>>...> results{};
+    std::stop_source stop;
+
+    std::atomic<size_t> pending{num_branches + 1};
+    std::atomic<bool> failed{false};
+    std::exception_ptr exception{};
+    std::coroutine_handle<> continuation{};
+    RunQueue* executor{nullptr};
+
+    template<size_t... I>
+    void start_all(std::index_sequence<I...>)
+    {
+        (run_one<I, std::tuple_element_t<I, std::tuple<Awaitables...>>>(std::forward<std::tuple_element_t<I, std::tuple<Awaitables...>>>(std::get<I>(awaitables)), this), ...);
+    }
+
+    void fail(std::exception_ptr ex)
+    {
+        if (!failed.exchange(true))
+        {
+            exception = std::move(ex);
+            stop.request_stop();
+        }
+    }
+
+    void arrive()
+    {
+        /* After the last arrival the awaitable may be gone, so nothing is touched past it. */
+        if (pending.fetch_sub(1) == 1)
+            resume_on(executor, continuation);
+    }
+
+    template<size_t Index, typename Awaitable>
+    static detached_task run_one(Awaitable aw, when_all_awaitable* self)
+    {
+        try
+        {
+            if constexpr (std::is_void_v<await_result_t<Awaitable>>)
+            {
+                co_await aw;
+                std::get<Index>(self->results).emplace();
+            }
+            else
+            {
+                std::get<Index>(self->results).emplace(co_await aw);
             }
+        }
+        catch (...)
+        {
+            self->fail(std::current_exception());
+        }
+
+        self->arrive();
+    }
+};
+
+/* As when_all_awaitable, for any number of awaitables of one type, such as a fan-out of probes. */
+template<typename Awaitable>
+class when_all_range_awaitable
+{
+public:
+
+    using value_type = normalize_void<await_result_t<Awaitable>>;
+
+    explicit when_all_range_awaitable(std::vector<Awaitable> aws, std::stop_source stop)
+        : awaitables(std::move(aws)), results(awaitables.size()), stop(std::move(stop)), pending(awaitables.size() + 1) {}
+
+    when_all_range_awaitable(const when_all_range_awaitable&) = delete;
+    when_all_range_awaitable& operator = (const when_all_range_awaitable&) = delete;
+
+    bool await_ready() noexcept { return awaitables.empty(); }
+
+    bool await_suspend(std::coroutine_handle<> h)
+    {
+        continuation = h;
+        executor = RunQueue::current();
+
+        for (size_t i = 0; i < awaitables.size(); ++i)
+            run_one(std::move(awaitables[i]), this, i);
+
+        return pending.fetch_sub(1) != 1;
+    }
+
+    std::vector<value_type> await_resume()
+    {
+        if (exception)
+            std::rethrow_exception(exception);
+
+        std::vector<value_type> out{};
+        out.reserve(results.size());
+
+        for (auto& result : results)
+            out.push_back(std::move(*result));
+
+        return out;
+    }
+
+private:
+
+    std::vector<Awaitable> awaitables;
+    std::vector<std::optional<value_type>> results;
+    std::stop_source stop;
+
+    std::atomic<size_t> pending;
+    std::atomic<bool> failed{false};
+    std::exception_ptr exception{};
+    std::coroutine_handle<> continuation{};
+    RunQueue* executor{nullptr};
+
+    void fail(std::exception_ptr ex)
+    {
+        if (!failed.exchange(true))
+        {
+            exception = std::move(ex);
+            stop.request_stop();
+        }
+    }
+
+    void arrive()
+    {
+        if (pending.fetch_sub(1) == 1)
+            resume_on(executor, continuation);
+    }
 
-            co_return true;
-        };
+    static detached_task run_one(Awaitable aw, when_all_range_awaitable* self, size_t index)
+    {
+        try
+        {
+            if constexpr (std::is_void_v<await_result_t<Awaitable>>)
+            {
+                co_await aw;
+                self->results[index].emplace();
+            }
+            else
+            {
+                self->results[index].emplace(co_await aw);
+            }
+        }
+        catch (...)
+        {
+            self->fail(std::current_exception());
+        }
 
-        runner(state);
+        self->arrive();
     }
 };
 
 template<typename... Awaitables>
-auto when_any(Awaitables&&... aw) 
+    requires no_stop_source<Awaitables...>
+auto when_all(Awaitables&&... aw)
+{
+    return when_all_awaitable<Awaitables...>(std::stop_source{std::nostopstate}, std::forward<Awaitables>(aw)...);
+}
+
+template<typename... Awaitables>
+auto when_all(std::stop_source stop, Awaitables&&... aw)
+{
+    return when_all_awaitable<Awaitables...>(std::move(stop), std::forward<Awaitables>(aw)...);
+}
+
+template<typename Awaitable>
+auto when_all_range(std::vector<Awaitable> aws, std::stop_source stop = std::stop_source{std::nostopstate})
 {
-    return when_any_awaitable<Awaitables...>(std::forward<Awaitables>(aw)...);
-}
\ No newline at end of file
+    return when_all_range_awaitable<Awaitable>(std::move(aws), std::move(stop));
+}
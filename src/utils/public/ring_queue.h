@@ -0,0 +1,317 @@
+#pragma once
+
+#include <atomic>
+#include <vector>
+#include <mutex>
+#include <optional>
+#include <coroutine>
+#include <bit>
+#include <algorithm>
+#include <cstddef>
+#include <cstdint>
+#include <utility>
+
+#include "run_queue.h"
+
+template<typename T>
+struct RingQueueAwaiter;
+
+/* A bounded, lock-free message queue with the same push/pop/async_pop interface as MessageQueue.
+Producers never block: push fails (leaving the message untouched) when the ring is full,
+which is how back-pressure reaches the sender. Messages are moved in and moved out, never copied.
+Pushing and popping are safe from any number of threads; the mutex only guards suspended awaiters. */
+template<typename T>
+class RingQueue
+{
+public:
+
+    static constexpr std::size_t default_capacity = 1024;
+
+    /* Capacity is rounded up to a power of two. */
+    explicit RingQueue(std::size_t capacity = default_capacity)
+        : mask_(std::bit_ceil(std::max<std::size_t>(capacity, 2)) - 1)
+        , cells_(mask_ + 1)
+    {
+        for (std::size_t i = 0; i < cells_.size(); ++i)
+            cells_[i].sequence.store(i, std::memory_order_relaxed);
+    }
+
+    RingQueue(const RingQueue&) = delete;
+    RingQueue& operator = (const RingQueue&) = delete;
+
+    ~RingQueue()
+    {
+        RingQueueAwaiter<T>* waiter = nullptr;
+
+        /* Scoped lock */
+        {
+            std::lock_guard<std::mutex> lock(waiter_mutex_);
+            waiter = std::exchange(waiters_head_, nullptr);
+            waiters_tail_ = nullptr;
+        }
+
+        while (waiter)
+        {
+            RingQueueAwaiter<T>* next = std::exchange(waiter->next_waiter_, nullptr);
+            waiter->next_ = T{};
+            resume_on(waiter->executor_, waiter->handle_);
+            waiter = next;
+        }
+    }
+
+    /* Push a message, or return false without consuming it if the queue is full.
+    If a coroutine is waiting on the queue, it is handed a message and resumed on this thread. */
+    [[nodiscard]] bool push(T&& message)
+    {
+        if (!try_enqueue(message))
+            return false;
+
+        /* Pairs with the fence in suspend_waiter; either we see the waiter, or it sees the message. */
+        std::atomic_thread_fence(std::memory_order_seq_cst);
+
+        if (num_waiters_.load(std::memory_order_relaxed) > 0)
+            hand_off();
+
+        return true;
+    }
+
+    std::optional<T> pop()
+    {
+        return try_dequeue();
+    }
+
+    RingQueueAwaiter<T> async_pop()
+    {
+        return RingQueueAwaiter<T>(this);
+    }
+
+    /* A snapshot; with concurrent producers it may be stale by the time it returns. */
+    bool empty() const
+    {
+        return size() == 0;
+    }
+
+    bool full() const
+    {
+        return size() >= capacity();
+    }
+
+    std::size_t size() const
+    {
+        std::size_t head = head_.load(std::memory_order_acquire);
+        std::size_t tail = tail_.load(std::memory_order_acquire);
+        return (tail > head) ? tail - head : 0;
+    }
+
+    std::size_t capacity() const
+    {
+        return mask_ + 1;
+    }
+
+private:
+
+    friend struct RingQueueAwaiter<T>;
+
+    /* Each cell's sequence says whose turn it is: equal to the position when free for a producer,
+    position + 1 once filled for a consumer, and advanced by a lap once consumed.
+    The value only exists while the cell is filled, so an empty ring constructs no messages. */
+    struct Cell
+    {
+        std::atomic<std::size_t> sequence{0};
+        std::optional<T> value{};
+    };
+
+    bool try_enqueue(T& message)
+    {
+        std::size_t pos = tail_.load(std::memory_order_relaxed);
+        Cell* cell = nullptr;
+
+        while (true)
+        {
+            cell = &cells_[pos & mask_];
+            std::size_t seq = cell->sequence.load(std::memory_order_acquire);
+            auto diff = static_cast<std::intptr_t>(seq) - static_cast<std::intptr_t>(pos);
+
+            if (diff == 0)
+            {
+                if (tail_.compare_exchange_weak(pos, pos + 1, std::memory_order_relaxed))
+                    break;
+            }
+            else if (diff < 0)
+            {
+                return false;
+            }
+            else
+            {
+                pos = tail_.load(std::memory_order_relaxed);
+            }
+        }
+
+        cell->value.emplace(std::move(message));
+        cell->sequence.store(pos + 1, std::memory_order_release);
+        return true;
+    }
+
+    std::optional<T> try_dequeue()
+    {
+        std::size_t pos = head_.load(std::memory_order_relaxed);
+        Cell* cell = nullptr;
+
+        while (true)
+        {
+            cell = &cells_[pos & mask_];
+            std::size_t seq = cell->sequence.load(std::memory_order_acquire);
+            auto diff = static_cast<std::intptr_t>(seq) - static_cast<std::intptr_t>(pos + 1);
+
+            if (diff == 0)
+            {
+                if (head_.compare_exchange_weak(pos, pos + 1, std::memory_order_relaxed))
+                    break;
+            }
+            else if (diff < 0)
+            {
+                return std::nullopt;
+            }
+            else
+            {
+                pos = head_.load(std::memory_order_relaxed);
+            }
+        }
+
+        std::optional<T> out{std::move(cell->value)};
+        cell->value.reset();
+        cell->sequence.store(pos + mask_ + 1, std::memory_order_release);
+        return out;
+    }
+
+    /* Register a suspending awaiter, unless a message is already available,
+    in which case it is given the message and should not suspend. */
+    bool suspend_waiter(RingQueueAwaiter<T>* waiter)
+    {
+        std::lock_guard<std::mutex> lock(waiter_mutex_);
+
+        num_waiters_.fetch_add(1, std::memory_order_relaxed);
+        std::atomic_thread_fence(std::memory_order_seq_cst);
+
+        if (auto msg = try_dequeue())
+        {
+            num_waiters_.fetch_sub(1, std::memory_order_relaxed);
+            waiter->next_ = std::move(msg);
+            return false;
+        }
+
+        if (waiters_tail_)
+            waiters_tail_->next_waiter_ = waiter;
+        else
+            waiters_head_ = waiter;
+
+        waiters_tail_ = waiter;
+        return true;
+    }
+
+    bool cancel_waiter(RingQueueAwaiter<T>* waiter)
+    {
+        std::lock_guard<std::mutex> lock(waiter_mutex_);
+
+        RingQueueAwaiter<T>* prev = nullptr;
+        for (RingQueueAwaiter<T>* it = waiters_head_; it; prev = it, it = it->next_waiter_)
+        {
+            if (it != waiter)
+                continue;
+
+            (prev ? prev->next_waiter_ : waiters_head_) = it->next_waiter_;
+            if (waiters_tail_ == it)
+                waiters_tail_ = prev;
+
+            it->next_waiter_ = nullptr;
+            num_waiters_.fetch_sub(1, std::memory_order_relaxed);
+            return true;
+        }
+
+        return false;
+    }
+
+    void hand_off()
+    {
+        RingQueueAwaiter<T>* waiter = nullptr;
+
+        /* Scoped lock */
+        {
+            std::lock_guard<std::mutex> lock(waiter_mutex_);
+
+            if (!waiters_head_)
+                return;
+
+            auto msg = try_dequeue();
+            if (!msg)
+                return;
+
+            waiter = waiters_head_;
+            waiters_head_ = std::exchange(waiter->next_waiter_, nullptr);
+            if (!waiters_head_)
+                waiters_tail_ = nullptr;
+
+            num_waiters_.fetch_sub(1, std::memory_order_relaxed);
+            waiter->next_ = std::move(msg);
+        }
+
+        resume_on(waiter->executor_, waiter->handle_);
+    }
+
+    const std::size_t mask_;
+    std::vector<Cell> cells_;
+
+    alignas(64) std::atomic<std::size_t> head_{0};
+    alignas(64) std::atomic<std::size_t> tail_{0};
+
+    alignas(64) std::atomic<std::size_t> num_waiters_{0};
+    std::mutex waiter_mutex_{};
+    RingQueueAwaiter<T>* waiters_head_{nullptr};
+    RingQueueAwaiter<T>* waiters_tail_{nullptr};
+
+};
+
+
+template<typename T>
+struct RingQueueAwaiter
+{
+	using OwningQueue = RingQueue<T>;
+
+	explicit RingQueueAwaiter(OwningQueue* owner)
+		: owner_(owner) { }
+
+	bool await_ready()
+	{
+		next_ = owner_->pop();
+		return next_.has_value();
+	}
+
+	bool await_suspend(std::coroutine_handle<> h)
+	{
+		handle_ = h;
+		executor_ = RunQueue::current();
+		return owner_->suspend_waiter(this);
+	}
+
+	T await_resume()
+	{
+		return std::move(next_).value();
+	}
+
+	/* Stop waiting; returns false if a message has already been handed over. */
+	bool cancel()
+	{
+		return owner_->cancel_waiter(this);
+	}
+
+private:
+
+	friend class RingQueue<T>;
+
+    OwningQueue* owner_{nullptr};
+	std::optional<T> next_{};
+	std::coroutine_handle<> handle_{};
+	RunQueue* executor_{nullptr};
+	RingQueueAwaiter* next_waiter_{nullptr};
+
+};
@@ -0,0 +1,94 @@
+#pragma once
+
+#include <coroutine>
+#include <mutex>
+#include <vector>
+#include <atomic>
+#include <chrono>
+#include <functional>
+#include <cstdint>
+
+struct RunQueueStats
+{
+    std::atomic<uint64_t> resumed{0};           // Total coroutines resumed.
+    std::atomic<std::size_t> peak_depth{0};     // Most coroutines ready at the start of one run.
+    std::atomic<uint64_t> last_latency_us{0};   // Time from post to resume, for the last resume.
+    std::atomic<uint64_t> peak_latency_us{0};
+    std::atomic<uint64_t> total_latency_us{0};  // Divide by 'resumed' for the mean.
+};
+
+/* A queue of coroutines that are ready to continue.
+Awaiters post their coroutine here rather than resuming it inline on whichever thread and stack
+produced the event; the owner (eg. the world tick) resumes them one at a time from run(),
+so chains of producers and consumers never nest deeper than a single resume. */
+class RunQueue
+{
+public:
+
+    using Clock = std::chrono::steady_clock;
+    using NotifyFn = std::function<void(void)>;
+
+    RunQueue() = default;
+    RunQueue(RunQueue&) = delete;
+
+    /* Queue a coroutine for resumption. Safe from any thread. */
+    void post(std::coroutine_handle<> h);
+
+    /* Resume everything posted before the call. Coroutines posted while running
+    wait for the next call, so a coroutine re-posting itself can't stall the caller.
+    Returns the number resumed. */
+    std::size_t run();
+
+    bool empty() const;
+    std::size_t size() const;
+
+    const RunQueueStats& get_stats() const { return stats_; }
+
+    /* Called (outside the lock) when a coroutine is posted from a thread that isn't
+    running this queue, so a sleeping owner can wake up. Set before use. */
+    void set_notify_callback(NotifyFn&& fn) { on_post_ = std::move(fn); }
+
+    /* The run queue made current on the calling thread, or nullptr. */
+    static RunQueue* current();
+
+    /* Makes a run queue current on this thread for the lifetime of the scope. */
+    class Scope
+    {
+    public:
+
+        explicit Scope(RunQueue& queue);
+        ~Scope();
+
+        Scope(Scope&) = delete;
+
+    private:
+
+        RunQueue* prev_{nullptr};
+    };
+
+private:
+
+    struct Entry
+    {
+        std::coroutine_handle<> handle{};
+        Clock::time_point posted{};
+    };
+
+    mutable std::mutex mutex_{};
+    std::vector<Entry> ready_{};
+    std::vector<Entry> running_{};
+
+    NotifyFn on_post_{nullptr};
+    RunQueueStats stats_{};
+
+};
+
+/* Resume a coroutine through the given run queue, or inline if there is none
+(eg. outside the world, in tools and benchmarks). */
+inline void resume_on(RunQueue* queue, std::coroutine_handle<> h)
+{
+    if (queue)
+        queue->post(h);
+    else
+        h.resume();
+}
@@ -1,7 +1,11 @@
 #pragma once
 
+#include "frame_pool.h"
+
 #include <coroutine>
 #include <optional>
+#include <utility>
+#include <atomic>
 
 #include <iostream>
 #include <thread>
@@ -16,6 +20,10 @@ struct Task;
 template<typename T, typename InitialSuspendT>
 struct TaskPromiseType
 {
+    /* Declared so the promise isn't an aggregate; otherwise the compiler may construct it
+    from the coroutine's arguments, initializing 'value' with the first one. */
+    TaskPromiseType() = default;
+
     // value to be computed
     // when task is not completed (coroutine didn't co_return anything yet) value is empty
     std::optional<T> value;
@@ -28,13 +36,38 @@ struct TaskPromiseType
     to be rethrown at return. */
     std::optional<std::exception_ptr> opt_except{};
 
+    /* Whether the body has begun running; lazy tasks start when first resumed or awaited. */
+    bool started{false};
+
+    /* Set by whichever of the Task object and the finished coroutine lets go of the frame first;
+    the second one destroys it. A Task dropped while its coroutine is still suspended thereby
+    detaches it, and the frame frees itself once the body completes. */
+    std::atomic<bool> released{false};
+
+    /* Frames come from thread-local size-class pools rather than the global heap. */
+    static void* operator new(std::size_t size) { return FramePool::allocate(size); }
+    static void operator delete(void* ptr, std::size_t size) noexcept { FramePool::deallocate(ptr, size); }
+
     // task is async result of our coroutine
     // it is created before execution of the coroutine body
     // it can be either co_awaited inside another coroutine
     // or used via special interface for extracting values (is_ready and get)
     Task<T, InitialSuspendT> get_return_object();
 
-    InitialSuspendT initial_suspend() { return {}; }
+    auto initial_suspend() noexcept
+    {
+        struct StartAwaitable
+        {
+            TaskPromiseType& promise;
+            InitialSuspendT inner{};
+
+            bool await_ready() noexcept { return inner.await_ready(); }
+            void await_suspend(std::coroutine_handle<> h) noexcept { inner.await_suspend(h); }
+            void await_resume() noexcept { promise.started = true; inner.await_resume(); }
+        };
+
+        return StartAwaitable{*this};
+    }
 
     // store value to be returned to awaiting coroutine or accessed through 'get' function
     void return_value(T val)
@@ -68,7 +101,13 @@ struct TaskPromiseType
             std::coroutine_handle<> await_suspend(std::coroutine_handle<TaskPromiseType> h) noexcept
             {
                 // Resume awaiting coroutine, or no-op coro if there is nothing to resume.
-                return awaiting_coroutine ? awaiting_coroutine : std::noop_coroutine();
+                std::coroutine_handle<> next = awaiting_coroutine ? awaiting_coroutine : std::noop_coroutine();
+
+                /* This awaitable lives in the frame, so 'next' is read out before a possible destroy. */
+                if (h.promise().released.exchange(true))
+                    h.destroy();
+
+                return next;
             }
 
             void await_resume() noexcept {}
@@ -90,16 +129,21 @@ struct Task
 
     Task& operator=(Task&& other)
     {
-        if (handle) 
+        if (this != &other)
         {
-            handle.destroy();
+            release();
+            handle = std::exchange(other.handle, nullptr);
         }
-        handle = std::exchange(other.handle, nullptr);
-        
+
         return *this;
     }
 
-    ~Task() = default;
+    /* A finished or never-started coroutine is destroyed with its Task.
+    One still suspended mid-body is detached, and destroys itself when it completes. */
+    ~Task()
+    {
+        release();
+    }
 
     /* Determine if the coroutine has finished. */
     bool is_done() const
@@ -129,21 +173,43 @@ struct Task
 
     std::coroutine_handle<promise_type> handle;
 
+    void release()
+    {
+        if (!handle)
+            return;
+
+        auto h = std::exchange(handle, nullptr);
+
+        if (!h.promise().started || h.promise().released.exchange(true))
+            h.destroy();
+    }
+
+    /* A task that finished by throwing has no value, but is still done. */
     bool await_ready()
     {
-        return is_ready();
+        return is_ready() || is_done();
     }
 
     // h - is a handle to coroutine that calls co_await
     // store coroutine handle to be resumed after computing task value
-    void await_suspend(std::coroutine_handle<> h)
+    std::coroutine_handle<> await_suspend(std::coroutine_handle<> h)
     {
         handle.promise().awaiting_coroutine = h;
+
+        /* A lazy task that hasn't started is started by symmetric transfer,
+        so the awaiter's stack doesn't grow. Otherwise, just suspend until final_suspend transfers back. */
+        if (!handle.promise().started)
+            return handle;
+
+        return std::noop_coroutine();
     }
 
     // when ready return value to a consumer
     auto await_resume()
     {
+        if (handle.promise().opt_except)
+            std::rethrow_exception(*handle.promise().opt_except);
+
         auto&& val = handle.promise().value;
         return (val.has_value()) ? *val : T{};
     }
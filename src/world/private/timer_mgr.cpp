@@ -1,101 +1,236 @@
 #include "timer_mgr.h"
 
 #include <coroutine>
+#include <algorithm>
 #include <print>
 
-void TimerManager::step(float delta_seconds)
+void TimerManager::step(TimerTimePoint now)
 {
-	for (std::size_t idx = 0; idx < timers_.size(); ++idx)
-	{
-		auto&& action = timers_[idx];
+	merge_staged();
 
-		if (!action.get_alive())
-			continue;
+	/* The deadline queue is only touched by the stepping thread, so it is read without the lock.
+	Timers set while this step runs (eg. a resumed coroutine waiting again) are staged,
+	and so are not due before the next step, even with a zero length. */
+	while (!queue_.empty() && queue_.top().expiry <= now)
+	{
+		TimerQueueEntry entry = queue_.top();
+		queue_.pop();
 
-		if (action.get_paused())
-			continue;
+		TimerCallbackFn event{};
+		bool looping = false;
 
-		if (float& time = action.get_remaining().get() -= delta_seconds; time < 0.f)
+		/* Scoped lock */
 		{
-			//std::lock_guard<std::mutex> lock(mutex_);
+			std::lock_guard<std::mutex> lock(mutex_);
 
-			auto&& event = action.get_invoker().get();
+			if (!is_live_entry(entry))
+				continue;
 
-			if (action.get_looping())
-			{
-				reset_timer_internal(idx);
-			}
-			else 
+			/* The callback is moved out before the slot can be reused,
+			so that set_timer calls from within it cannot overwrite it mid-call. */
+			auto&& timer = timers_[entry.idx];
+			event = std::move(timer.get_invoker().get());
+			looping = timer.get_looping();
+
+			if (!looping)
+				kill_timer_internal(entry.idx);
+		}
+
+		std::invoke(event);
+
+		if (looping)
+		{
+			std::lock_guard<std::mutex> lock(mutex_);
+
+			/* Only re-arm if the callback didn't cancel or pause its own timer. */
+			if (is_live_entry(entry))
 			{
-				kill_timer_internal(idx);
+				timers_[entry.idx].get_invoker().get() = std::move(event);
+				rearm_.push_back(entry);
 			}
+		}
+	}
+
+	if (rearm_.empty())
+		return;
 
-			std::invoke(event);
+	/* Scoped lock */
+	{
+		std::lock_guard<std::mutex> lock(mutex_);
+
+		for (const TimerQueueEntry& entry : rearm_)
+		{
+			/* Re-arm from the previous expiry rather than from now, so looping timers don't drift.
+			If we have fallen behind by more than a period, fire on the next step instead of bursting. */
+			TimerTimePoint expiry = entry.expiry + timers_[entry.idx].get_length().get();
+			stage_timer_internal(entry.idx, std::max(expiry, now));
 		}
 	}
+
+	rearm_.clear();
+}
+
+void TimerManager::merge_staged()
+{
+	/* Scoped lock */
+	{
+		std::lock_guard<std::mutex> lock(mutex_);
+		std::swap(staging_, merging_);
+		staged_expiry_ = std::nullopt;
+	}
+
+	/* Heap insertion happens outside the lock, so setters never wait on it. */
+	for (const TimerQueueEntry& entry : merging_)
+		queue_.push(entry);
+
+	merging_.clear();
 }
 
-TimerHandle TimerManager::set_timer(float seconds, TimerCallbackFn event, bool looping)
+TimerHandle TimerManager::set_timer(TimerDuration length, TimerCallbackFn event, bool looping)
 {
-	std::lock_guard<std::mutex> lock(mutex_);
+	TimerHandle out{};
+	set_timer_internal(length, std::move(event), looping, out);
+	return out;
+}
 
-	const std::size_t new_idx = [this]
+void TimerManager::set_timer(TimerDuration length, TimerCallbackFn event, TimerHandle& out)
+{
+	set_timer_internal(length, std::move(event), false, out);
+}
+
+void TimerManager::set_timer_internal(TimerDuration length, TimerCallbackFn&& event, bool looping, TimerHandle& out)
+{
+	TimerTimePoint expiry = TimerClock::now() + length;
+
+	/* Scoped lock */
 	{
-		if (!free_instances_.empty())
-			return free_instances_.extract(std::begin(free_instances_)).value();
-
-		std::size_t out = timers_.size();
-		timers_.resize(out + 1);
-		return out;
-	}();
-
-	auto&& timer = timers_[new_idx];
-	timer.get_remaining().get() = seconds;
-	timer.get_length().get() = seconds;
-	timer.get_invoker().get() = std::move(event);
-	timer.get_alive().get() = true;
-	timer.get_looping().get() = looping;
-
-	return { static_cast<int32_t>(new_idx) };
+		std::lock_guard<std::mutex> lock(mutex_);
+
+		const std::size_t new_idx = [this]
+		{
+			if (free_head_ != no_free_slot)
+			{
+				std::size_t out = free_head_;
+				free_head_ = timers_[out].get_next_free();
+				return out;
+			}
+
+			std::size_t out = timers_.size();
+			timers_.resize(out + 1);
+			return out;
+		}();
+
+		auto&& timer = timers_[new_idx];
+		timer.get_length().get() = length;
+		timer.get_invoker().get() = std::move(event);
+		timer.get_alive().get() = true;
+		timer.get_paused().get() = false;
+		timer.get_looping().get() = looping;
+		++num_alive_;
+
+		/* Written before staging, while the lock keeps the stepping thread from firing it. */
+		out = { static_cast<int32_t>(new_idx), timer.get_generation() };
+
+		stage_timer_internal(new_idx, expiry);
+	}
+
+	if (on_schedule_)
+		on_schedule_(expiry);
 }
 
 void TimerManager::pause_timer(const TimerHandle& handle)
 {
 	std::lock_guard<std::mutex> lock(mutex_);
 
-	if (is_valid_handle(handle))
+	if (is_valid_handle_internal(handle))
 	{
 		auto&& timer = timers_[handle.idx];
 		timer.get_paused().get() = true;
 	}
 }
 
-void TimerManager::cancel_timer(const TimerHandle &handle)
+bool TimerManager::cancel_timer(const TimerHandle &handle)
 {
 	std::lock_guard<std::mutex> lock(mutex_);
 
-	if (is_valid_handle(handle))
+	if (!is_valid_handle_internal(handle))
+		return false;
+
+	kill_timer_internal(handle.idx);
+	return true;
+}
+
+bool TimerManager::is_valid_handle(const TimerHandle& handle)
+{
+	std::lock_guard<std::mutex> lock(mutex_);
+	return is_valid_handle_internal(handle);
+}
+
+TimerAwaiter TimerManager::wait(TimerDuration length)
+{
+	return TimerAwaiter{this, length};
+}
+
+std::optional<TimerTimePoint> TimerManager::get_next_expiry() const
+{
+	std::optional<TimerTimePoint> next{};
+
+	/* Scoped lock */
 	{
-		kill_timer_internal(handle.idx);
+		std::lock_guard<std::mutex> lock(mutex_);
+		next = staged_expiry_;
 	}
+
+	/* The top may be a stale entry, in which case this errs on the early side. */
+	if (!queue_.empty() && (!next || queue_.top().expiry < *next))
+		next = queue_.top().expiry;
+
+	return next;
 }
 
-TimerAwaiter TimerManager::wait(float seconds)
+std::size_t TimerManager::get_num_pending() const
 {
-	return TimerAwaiter{this, seconds};
+	std::lock_guard<std::mutex> lock(mutex_);
+	return num_alive_;
 }
 
-void TimerManager::reset_timer_internal(std::size_t idx)
+void TimerManager::stage_timer_internal(std::size_t idx, TimerTimePoint expiry)
 {
 	auto&& timer = timers_[idx];
-	float len = timer.get_length();
-	timer.get_alive().get() = true;
-	timer.get_remaining().get() = len;
+	uint64_t order = order_counter_++;
+	timer.get_expiry().get() = expiry;
+	timer.get_order().get() = order;
+	staging_.push_back({ expiry, order, idx });
+
+	if (!staged_expiry_ || expiry < *staged_expiry_)
+		staged_expiry_ = expiry;
 }
 
 void TimerManager::kill_timer_internal(std::size_t idx)
 {
 	auto&& timer = timers_[idx];
 	timer.get_alive().get() = false;
-	free_instances_.insert(idx);
-}
\ No newline at end of file
+	timer.get_invoker().get() = nullptr;
+
+	/* Invalidate outstanding handles before the slot goes back on the free list. */
+	++timer.get_generation().get();
+	timer.get_next_free().get() = free_head_;
+	free_head_ = idx;
+
+	--num_alive_;
+}
+
+bool TimerManager::is_live_entry(const TimerQueueEntry& entry)
+{
+	auto&& timer = timers_[entry.idx];
+	return timer.get_alive() && !timer.get_paused() && timer.get_order() == entry.order;
+}
+
+bool TimerManager::is_valid_handle_internal(const TimerHandle& handle)
+{
+	if (handle.idx < 0 || handle.idx >= static_cast<int32_t>(timers_.size()))
+		return false;
+
+	auto&& timer = timers_[handle.idx];
+	return timer.get_alive() && timer.get_generation() == handle.gen;
+}
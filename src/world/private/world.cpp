@@ -1,4 +1,5 @@
 #include "world.h"
+#include "file_generations.h"
 
 #include "host.h"
 #include "task.h"
@@ -7,52 +8,332 @@
 #include <chrono>
 #include <cmath>
 #include <thread>
+#include <ranges>
+#include <algorithm>
+#include <iterator>
+#include <cassert>
+#include <format>
+#include <vector>
+#include <mutex>
+
+namespace
+{
+	/* Runs fn over [0, count) on up to num_threads threads (zero means one per core), the caller being one of them.
+	Stops handing out work after the first error, which is the one returned. */
+	template<typename Fn>
+	std::error_condition parallel_for(std::size_t count, std::size_t num_threads, Fn&& fn)
+	{
+		if (num_threads == 0)
+			num_threads = std::max(1u, std::thread::hardware_concurrency());
+
+		num_threads = std::min(num_threads, count);
+
+		std::atomic<std::size_t> next{0};
+		std::mutex err_lock{};
+		std::error_condition first_err{};
+
+		auto work = [&]()
+		{
+			for (std::size_t i = next++; i < count; i = next++)
+			{
+				if (auto err = fn(i))
+				{
+					std::lock_guard lock(err_lock);
+					if (!first_err)
+						first_err = err;
+
+					next = count;
+				}
+			}
+		};
+
+		/* Scoped threads */
+		{
+			std::vector<std::jthread> workers{};
+			for (std::size_t i = 1; i < num_threads; ++i)
+				workers.emplace_back(work);
+
+			if (num_threads > 0)
+				work();
+		}
+
+		return first_err;
+	}
+}
+
+World::~World()
+{
+	/* Stop the workers before the members they use go away. */
+	for (auto& shard : shards_)
+		shard->stop();
+
+	worker_ = {};
+}
 
 void World::init_world()
 {
+	if (!shards_.empty())
+	{
+		for (auto& shard : shards_)
+			shard->init_hosts();
+
+		return;
+	}
+
 	for (auto&& [id, host] : hosts_)
 	{
 		host->init(&services_);
 	}
 }
 
+void World::set_shard_params(const WorldShardParams& params)
+{
+	assert(hosts_.empty());
+
+	shard_params_ = params;
+	shards_.clear();
+
+	if (params.num_shards < 2)
+		return;
+
+	for (uint32_t i = 0; i < params.num_shards; ++i)
+		shards_.push_back(std::make_unique<WorldShard>(i));
+}
+
 void World::update_world(float delta_seconds)
 {
 	/* Apply thread-safe updates. */
-	if (auto opt = queue_.pop(); opt.has_value())
-    {
-        std::invoke(*opt);
-    }
+	drain_queue();
 
 	/* Update timers. */
-    timers_.step(delta_seconds);
+    timers_.step(TimerClock::now());
 
+	/* Resume coroutines woken by the above, or by other threads since the last update. */
+	run_queue_.run();
 }
 
 void World::launch()
 {
 	init_world();
+
+	/* Timers set from other threads may be due before the worker's current deadline. */
+	timers_.set_schedule_callback([this](TimerTimePoint due)
+	{
+		if (std::this_thread::get_id() == worker_id_.load(std::memory_order_acquire))
+			return;
+
+		if (due.time_since_epoch().count() < sleep_deadline_.load(std::memory_order_acquire))
+			wake();
+	});
+
+	/* Coroutines woken from other threads (eg. asio) are resumed by the worker. */
+	run_queue_.set_notify_callback([this] { wake(); });
+
+	last_update_ = std::chrono::steady_clock::now();
+
+	if (!shards_.empty())
+	{
+		std::vector<WorldShard*> siblings{};
+		for (auto& shard : shards_)
+			siblings.push_back(shard.get());
+
+		for (auto& shard : shards_)
+			shard->connect(siblings, shard_params_.steal, tick_params_.max_sleep);
+
+		for (auto& shard : shards_)
+			shard->launch();
+	}
 	
-	worker_ = std::jthread([this]
+	worker_ = std::jthread([this](std::stop_token stop)
+	{
+		worker_id_.store(std::this_thread::get_id(), std::memory_order_release);
+		RunQueue::Scope scope{run_queue_};
+
+		while (run_ && !stop.stop_requested())
+		{
+			tick(stop);
+		}
+	});
+}
+
+void World::post(MessageFn&& fn)
+{
+	queue_.push(std::move(fn));
+	wake();
+}
+
+void World::wake()
+{
+	/* Scoped lock */
+	{
+		std::lock_guard<std::mutex> lock(wake_mutex_);
+		wake_pending_ = true;
+	}
+	wake_cv_.notify_one();
+}
+
+void World::tick(std::stop_token stop)
+{
+	using namespace std::chrono;
+
+	const auto t1 = steady_clock::now();
+	const duration<float> elapsed = t1 - last_update_;
+	last_update_ = t1;
+
+	const duration<float> step = tick_params_.timestep;
+
+	switch (tick_params_.mode)
 	{
-		while (run_)
+		case WorldTickMode::Polling:
 		{
-			auto t1 = std::chrono::high_resolution_clock::now();
-			std::chrono::duration<float> sec(t1 - last_update_);
-			last_update_ = t1;
+			update_world(elapsed.count());
+			std::this_thread::sleep_for(milliseconds(1));
+			return;
+		}
+		case WorldTickMode::Fixed:
+		{
+			accumulator_ += elapsed;
+
+			uint32_t steps = 0;
+			while (accumulator_ >= step && steps < tick_params_.max_steps)
+			{
+				update_world(step.count());
+				accumulator_ -= step;
+				++steps;
+			}
 
-			float dt = sec.count();
-			update_world(dt);
+			/* Too far behind to catch up; drop the backlog rather than spiral. */
+			if (accumulator_ >= step)
+				accumulator_ = step;
 
-			std::this_thread::sleep_for(std::chrono::milliseconds(1));
+			/* Woken between steps: run posted work now, timers wait for the next step. */
+			if (steps == 0)
+			{
+				drain_queue();
+				run_queue_.run();
+			}
+
+			auto next = t1 + duration_cast<steady_clock::duration>(step - accumulator_);
+			if (!run_queue_.empty())
+				next = t1;
+
+			sleep_until(stop, next);
+			return;
 		}
-	});
+		case WorldTickMode::SemiFixed:
+		{
+			duration<float> frame = elapsed;
+
+			uint32_t steps = 0;
+			do
+			{
+				duration<float> dt = std::min(frame, step);
+				update_world(dt.count());
+				frame -= dt;
+			}
+			while (frame.count() > 0.f && ++steps < tick_params_.max_steps);
+
+			auto next = steady_clock::now() + tick_params_.max_sleep;
+			if (auto expiry = timers_.get_next_expiry(); expiry.has_value())
+			{
+				next = std::min(next, *expiry);
+			}
+
+			/* Coroutines posted during the last run are resumed without sleeping. */
+			if (!run_queue_.empty())
+				next = t1;
+
+			sleep_until(stop, next);
+			return;
+		}
+	}
+}
+
+void World::sleep_until(std::stop_token stop, std::chrono::steady_clock::time_point deadline)
+{
+	std::unique_lock<std::mutex> lock(wake_mutex_);
+
+	sleep_deadline_.store(deadline.time_since_epoch().count(), std::memory_order_release);
+	wake_cv_.wait_until(lock, stop, deadline, [this]{ return wake_pending_; });
+	sleep_deadline_.store(std::chrono::steady_clock::duration::max().count(), std::memory_order_release);
+
+	wake_pending_ = false;
+}
+
+std::size_t World::drain_queue()
+{
+	using namespace std::chrono;
+
+	const auto t1 = steady_clock::now();
+
+	if (queue_params_.mode == WorldQueueMode::Single)
+	{
+		if (pending_.empty())
+		{
+			if (auto opt = queue_.pop(); opt.has_value())
+				pending_.push_back(std::move(*opt));
+		}
+	}
+	else if (pending_.empty())
+	{
+		pending_ = queue_.copy_clear();
+	}
+	else
+	{
+		/* Leftovers from an exhausted budget run before anything newer. */
+		std::ranges::move(queue_.copy_clear(), std::back_inserter(pending_));
+	}
+
+	std::size_t depth = pending_.size();
+	queue_stats_.depth.store(depth, std::memory_order_relaxed);
+	if (depth > queue_stats_.peak_depth.load(std::memory_order_relaxed))
+		queue_stats_.peak_depth.store(depth, std::memory_order_relaxed);
+
+	const std::size_t max_messages = queue_params_.max_messages;
+	const microseconds max_time = queue_params_.max_time;
+
+	std::size_t count = 0;
+	while (!pending_.empty())
+	{
+		if (max_messages > 0 && count >= max_messages)
+			break;
+
+		if (max_time.count() > 0 && steady_clock::now() - t1 >= max_time)
+			break;
+
+		MessageFn fn = std::move(pending_.front());
+		pending_.pop_front();
+		std::invoke(fn);
+		++count;
+	}
+
+	uint64_t us = duration_cast<microseconds>(steady_clock::now() - t1).count();
+	queue_stats_.drained.fetch_add(count, std::memory_order_relaxed);
+	queue_stats_.last_drain_us.store(us, std::memory_order_relaxed);
+	if (us > queue_stats_.peak_drain_us.load(std::memory_order_relaxed))
+		queue_stats_.peak_drain_us.store(us, std::memory_order_relaxed);
+
+	return count;
 }
 
 Host* World::add_host(Uid64 id, std::unique_ptr<Host>&& new_host)
 {
 	auto [it, success] = hosts_.emplace(id, std::move(new_host));
-	return (success) ? it->second.get() : nullptr;
+	if (!success)
+		return nullptr;
+
+	Host* host = it->second.get();
+
+	if (shards_.empty())
+	{
+		host->set_executor(&run_queue_);
+		return host;
+	}
+
+	/* Round-robin; each host stays on its home shard for life, unless stolen for a run. */
+	WorldShard& shard = *shards_[(hosts_.size() - 1) % shards_.size()];
+	host->set_executor(&shard.adopt(host)->queue);
+	return host;
 }
 
 bool World::serialize(world::World* to)
@@ -67,6 +348,199 @@ bool World::serialize(world::World* to)
 	return true;
 }
 
+bool World::serialize_changes(world::World* to)
+{
+	for (auto& [id, host] : hosts_)
+	{
+		world::Host* ar = to->add_hosts();
+		ar->set_uid(id.num);
+		host->serialize_changes(ar);
+
+		/* Hosts with nothing to say are left out. */
+		if (ar->files().files_size() == 0)
+			to->mutable_hosts()->RemoveLast();
+	}
+
+	return true;
+}
+
+std::error_condition World::save_images(const std::filesystem::path& dir) const
+{
+	/* Loaded images stay mapped, so each save goes to a new generation directory rather than over them.
+	It is filled under a temporary name, so a failed save never looks like the newest generation. */
+	const std::filesystem::path base = dir / "fsimg";
+	auto latest = FileGenerations::find_latest(base);
+	const uint64_t gen = latest ? latest->first + 1 : 1;
+
+	const std::filesystem::path gen_dir = FileGenerations::get_path(base, gen);
+	std::filesystem::path temp_dir = gen_dir;
+	temp_dir += ".tmp";
+
+	std::error_code ec{};
+	std::filesystem::remove_all(temp_dir, ec);
+	if (!std::filesystem::create_directories(temp_dir, ec))
+		return {EIO, std::generic_category()};
+
+	for (auto& [id, host] : hosts_)
+	{
+		if (auto err = host->save_image(temp_dir / std::format("{}.fsimg", id.num)))
+		{
+			std::filesystem::remove_all(temp_dir, ec);
+			return err;
+		}
+	}
+
+	std::filesystem::rename(temp_dir, gen_dir, ec);
+	if (ec)
+	{
+		std::filesystem::remove_all(temp_dir, ec);
+		return {EIO, std::generic_category()};
+	}
+
+	FileGenerations::remove_older(base, gen);
+	return {};
+}
+
+std::error_condition World::load_images(const std::filesystem::path& dir)
+{
+	auto latest = FileGenerations::find_latest(dir / "fsimg");
+	if (!latest)
+		return {};
+
+	for (auto& [id, host] : hosts_)
+	{
+		std::filesystem::path path = latest->second / std::format("{}.fsimg", id.num);
+
+		std::error_code ec{};
+		if (!std::filesystem::exists(path, ec))
+			continue;
+
+		if (auto err = host->load_image(path))
+			return err;
+	}
+
+	return {};
+}
+
+std::error_condition World::save_snapshot(const std::filesystem::path& path, std::size_t num_threads)
+{
+	/* A new generation each time, since an open snapshot of the last one stays mapped (see FileGenerations). */
+	auto latest = FileGenerations::find_latest(path);
+	const uint64_t gen = latest ? latest->first + 1 : 1;
+
+	auto exp_writer = WorldSnapshotWriter::create(FileGenerations::get_path(path, gen));
+	if (!exp_writer)
+		return exp_writer.error();
+
+	std::unique_ptr<WorldSnapshotWriter> writer = std::move(exp_writer).value();
+
+	std::vector<std::pair<Uid64, Host*>> hosts{};
+	hosts.reserve(hosts_.size());
+	for (auto& [id, host] : hosts_)
+		hosts.emplace_back(id, host.get());
+
+	/* Each host is serialized into a message of its own and dropped once written,
+	so at most one message per thread is held at a time. */
+	auto err = parallel_for(hosts.size(), num_threads, [&](std::size_t i) -> std::error_condition
+	{
+		auto [id, host] = hosts[i];
+
+		world::Host ar{};
+		ar.set_uid(id.num);
+		host->serialize(&ar);
+
+		return writer->add_host(id, ar);
+	});
+
+	if (err)
+		return err;
+
+	if (auto finish_err = writer->finish())
+		return finish_err;
+
+	FileGenerations::remove_older(path, gen);
+	return {};
+}
+
+std::error_condition World::load_snapshot(const std::filesystem::path& path, std::size_t num_threads)
+{
+	if (auto err = open_snapshot(path))
+		return err;
+
+	std::shared_ptr<const WorldSnapshot> snapshot{};
+	std::vector<Uid64> ids{};
+
+	/* Scoped lock */
+	{
+		std::lock_guard lock(snapshot_lock_);
+		snapshot = std::move(snapshot_);
+		ids.assign(unloaded_hosts_.begin(), unloaded_hosts_.end());
+		unloaded_hosts_.clear();
+	}
+
+	/* Hosts are independent of each other, so each is parsed and loaded on whichever thread picks it up. */
+	return parallel_for(ids.size(), num_threads, [&](std::size_t i) -> std::error_condition
+	{
+		world::Host ar{};
+		if (auto err = snapshot->read_host(ids[i], &ar))
+			return err;
+
+		if (!hosts_.at(ids[i])->deserialize(ar))
+			return {EINVAL, std::generic_category()};
+
+		return {};
+	});
+}
+
+std::error_condition World::open_snapshot(const std::filesystem::path& path)
+{
+	auto latest = FileGenerations::find_latest(path);
+	if (!latest)
+		return {ENOENT, std::generic_category()};
+
+	auto exp_snapshot = WorldSnapshot::open(latest->second);
+	if (!exp_snapshot)
+		return exp_snapshot.error();
+
+	std::lock_guard lock(snapshot_lock_);
+
+	snapshot_ = std::move(exp_snapshot).value();
+	unloaded_hosts_.clear();
+
+	for (const WorldSnapshotEntry& entry : snapshot_->get_index())
+	{
+		if (hosts_.contains(Uid64(entry.uid)))
+			unloaded_hosts_.insert(Uid64(entry.uid));
+	}
+
+	return {};
+}
+
+bool World::load_host(Uid64 id)
+{
+	std::shared_ptr<const WorldSnapshot> snapshot{};
+
+	/* Scoped lock */
+	{
+		std::lock_guard lock(snapshot_lock_);
+
+		if (!snapshot_ || unloaded_hosts_.erase(id) == 0)
+			return false;
+
+		snapshot = snapshot_;
+
+		/* Let go of the mapping once every host has been loaded. */
+		if (unloaded_hosts_.empty())
+			snapshot_ = nullptr;
+	}
+
+	world::Host ar{};
+	if (snapshot->read_host(id, &ar))
+		return false;
+
+	return hosts_.at(id)->deserialize(ar);
+}
+
 bool World::deserialize(const world::World* from)
 {
 	for (auto&& ar : from->hosts())
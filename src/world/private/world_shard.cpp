@@ -0,0 +1,227 @@
+#include "world_shard.h"
+
+#include "host.h"
+
+#include <algorithm>
+
+WorldShard::WorldShard(uint32_t index)
+	: index_(index) { }
+
+HostStrand* WorldShard::adopt(Host* host)
+{
+	auto& strand = strands_.emplace_back(std::make_unique<HostStrand>());
+	strand->host = host;
+	strand->home = this;
+
+	/* Posts from outside the strand (other hosts, timers, asio) put it on the ready list.
+	Posts from within it are picked up when the current run finishes. */
+	strand->queue.set_notify_callback([s = strand.get()]
+	{
+		s->home->schedule(*s);
+	});
+
+	return strand.get();
+}
+
+void WorldShard::init_hosts()
+{
+	for (auto& strand : strands_)
+		strand->host->init(&services_);
+}
+
+void WorldShard::connect(std::vector<WorldShard*> siblings, bool steal, std::chrono::microseconds max_sleep)
+{
+	siblings_ = std::move(siblings);
+	steal_ = steal;
+	max_sleep_ = max_sleep;
+}
+
+void WorldShard::launch()
+{
+	timers_.set_schedule_callback([this](TimerTimePoint due)
+	{
+		if (std::this_thread::get_id() == worker_id_.load(std::memory_order_acquire))
+			return;
+
+		if (due.time_since_epoch().count() < sleep_deadline_.load(std::memory_order_acquire))
+			wake();
+	});
+
+	/* Strands that got work before launch (eg. hosts booted from the main thread). */
+	for (auto& strand : strands_)
+	{
+		if (!strand->queue.empty())
+			schedule(*strand);
+	}
+
+	worker_ = std::jthread([this](std::stop_token stop)
+	{
+		worker_id_.store(std::this_thread::get_id(), std::memory_order_release);
+
+		while (!stop.stop_requested())
+		{
+			tick(stop);
+		}
+	});
+}
+
+void WorldShard::stop()
+{
+	worker_ = {};
+}
+
+void WorldShard::schedule(HostStrand& strand)
+{
+	if (strand.scheduled.exchange(true))
+		return;
+
+	std::size_t depth = 0;
+
+	/* Scoped lock */
+	{
+		std::lock_guard<std::mutex> lock(ready_mutex_);
+		ready_.push_back(&strand);
+		depth = ready_.size();
+	}
+
+	wake();
+
+	/* More ready than we can start right now; nudge a sibling to come and steal. */
+	if (steal_ && depth > 1 && siblings_.size() > 1)
+	{
+		WorldShard* next = siblings_[(index_ + 1) % siblings_.size()];
+		if (next != this)
+			next->wake();
+	}
+}
+
+void WorldShard::wake()
+{
+	/* Scoped lock */
+	{
+		std::lock_guard<std::mutex> lock(wake_mutex_);
+		wake_pending_ = true;
+	}
+	wake_cv_.notify_one();
+}
+
+void WorldShard::tick(std::stop_token stop)
+{
+	using namespace std::chrono;
+
+	const auto t1 = steady_clock::now();
+	stats_.ticks.fetch_add(1, std::memory_order_relaxed);
+
+	timers_.step(t1);
+
+	/* Only what was ready at the start, so a strand that keeps re-posting itself can't starve the timers. */
+	std::size_t budget = 0;
+
+	/* Scoped lock */
+	{
+		std::lock_guard<std::mutex> lock(ready_mutex_);
+		budget = ready_.size();
+	}
+
+	bool busy = false;
+	for (; budget > 0; --budget)
+	{
+		HostStrand* strand = pop_ready();
+		if (!strand)
+			break;
+
+		run_strand(*strand);
+		busy = true;
+	}
+
+	if (!busy && steal_)
+	{
+		if (HostStrand* strand = try_steal())
+		{
+			run_strand(*strand);
+			stats_.stolen.fetch_add(1, std::memory_order_relaxed);
+			busy = true;
+		}
+	}
+
+	auto next = steady_clock::now() + max_sleep_;
+	if (auto expiry = timers_.get_next_expiry(); expiry.has_value())
+	{
+		next = std::min(next, *expiry);
+	}
+
+	/* Keep going while there is work, here or (possibly) to steal. */
+	if (busy)
+		next = t1;
+
+	sleep_until(stop, next);
+}
+
+void WorldShard::run_strand(HostStrand& strand)
+{
+	/* Scoped executor */
+	{
+		RunQueue::Scope scope{strand.queue};
+		strand.queue.run();
+	}
+
+	stats_.strands_run.fetch_add(1, std::memory_order_relaxed);
+
+	/* Anything posted while running (from within, so without notifying) goes back on the home shard. */
+	strand.scheduled.store(false);
+	if (!strand.queue.empty())
+		strand.home->schedule(strand);
+}
+
+HostStrand* WorldShard::pop_ready()
+{
+	std::lock_guard<std::mutex> lock(ready_mutex_);
+
+	if (ready_.empty())
+		return nullptr;
+
+	HostStrand* strand = ready_.front();
+	ready_.pop_front();
+	return strand;
+}
+
+HostStrand* WorldShard::steal_ready()
+{
+	std::lock_guard<std::mutex> lock(ready_mutex_);
+
+	/* Leave a shard its last strand; it is about to run it anyway. */
+	if (ready_.size() < 2)
+		return nullptr;
+
+	HostStrand* strand = ready_.back();
+	ready_.pop_back();
+	return strand;
+}
+
+HostStrand* WorldShard::try_steal()
+{
+	const std::size_t num = siblings_.size();
+
+	for (std::size_t i = 1; i < num; ++i)
+	{
+		WorldShard* victim = siblings_[(index_ + i) % num];
+		if (victim == this)
+			continue;
+
+		if (HostStrand* strand = victim->steal_ready())
+			return strand;
+	}
+
+	return nullptr;
+}
+
+void WorldShard::sleep_until(std::stop_token stop, std::chrono::steady_clock::time_point deadline)
+{
+	std::unique_lock<std::mutex> lock(wake_mutex_);
+
+	sleep_deadline_.store(deadline.time_since_epoch().count(), std::memory_order_release);
+	wake_cv_.wait_until(lock, stop, deadline, [this]{ return wake_pending_; });
+	sleep_deadline_.store(std::chrono::steady_clock::duration::max().count(), std::memory_order_release);
+
+	wake_pending_ = false;
+}
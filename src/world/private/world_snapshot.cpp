@@ -0,0 +1,196 @@
+#include "world_snapshot.h"
+
+#include "mapped_file.h"
+
+#include "proto/host.pb.h"
+
+#include <cstring>
+#include <climits>
+#include <type_traits>
+
+namespace
+{
+	constexpr char snapshot_magic[8] = {'D', 'B', 'C', 'W', 'O', 'R', 'L', 'D'};
+	constexpr uint32_t snapshot_version = 1;
+
+	/* Followed by the host records; the index comes last, since it isn't known until they are written. */
+	struct SnapshotHeader
+	{
+		char magic[8]{};
+		uint32_t version{0};
+		uint32_t reserved{0};
+		uint64_t num_hosts{0};
+		uint64_t index_offset{0};
+	};
+
+	/* Precedes each record, so that a snapshot can also be read front to back without its index. */
+	struct SnapshotRecordHeader
+	{
+		uint64_t uid{0};
+		uint64_t size{0};
+	};
+
+	static_assert(std::is_trivially_copyable_v<SnapshotHeader>);
+	static_assert(std::is_trivially_copyable_v<SnapshotRecordHeader>);
+	static_assert(std::is_trivially_copyable_v<WorldSnapshotEntry>);
+}
+
+/* --- Writer --- */
+
+std::expected<std::unique_ptr<WorldSnapshotWriter>, std::error_condition> WorldSnapshotWriter::create(const std::filesystem::path& path)
+{
+	std::unique_ptr<WorldSnapshotWriter> writer(new WorldSnapshotWriter());
+	writer->path_ = path;
+	writer->temp_path_ = path;
+	writer->temp_path_ += ".tmp";
+
+	writer->out_.open(writer->temp_path_, std::ios::binary | std::ios::trunc);
+	if (!writer->out_)
+		return std::unexpected(std::error_condition{EIO, std::generic_category()});
+
+	/* A placeholder until finish() knows where the index is. */
+	SnapshotHeader header{};
+	writer->out_.write(reinterpret_cast<const char*>(&header), sizeof(header));
+	writer->offset_ = sizeof(header);
+
+	return writer;
+}
+
+WorldSnapshotWriter::~WorldSnapshotWriter()
+{
+	/* Never finished; leave nothing half-written behind. */
+	if (out_.is_open())
+	{
+		out_.close();
+		std::error_code ec{};
+		std::filesystem::remove(temp_path_, ec);
+	}
+}
+
+std::error_condition WorldSnapshotWriter::add_host(Uid64 id, const world::Host& host)
+{
+	/* Serialized outside the lock, which is where the time goes. */
+	std::string bytes{};
+	if (!host.SerializeToString(&bytes))
+		return {EINVAL, std::generic_category()};
+
+	SnapshotRecordHeader record{ .uid = id.num, .size = bytes.size() };
+
+	/* Scoped lock */
+	{
+		std::lock_guard lock(write_lock_);
+
+		if (failed_ || !out_.is_open())
+			return {EIO, std::generic_category()};
+
+		out_.write(reinterpret_cast<const char*>(&record), sizeof(record));
+		out_.write(bytes.data(), static_cast<std::streamsize>(bytes.size()));
+
+		if (!out_)
+		{
+			failed_ = true;
+			return {EIO, std::generic_category()};
+		}
+
+		index_.push_back({ .uid = id.num, .offset = offset_ + sizeof(record), .size = bytes.size() });
+		offset_ += sizeof(record) + bytes.size();
+	}
+
+	return {};
+}
+
+std::error_condition WorldSnapshotWriter::finish()
+{
+	std::lock_guard lock(write_lock_);
+
+	if (failed_ || !out_.is_open())
+		return {EIO, std::generic_category()};
+
+	SnapshotHeader header{};
+	std::memcpy(header.magic, snapshot_magic, sizeof(header.magic));
+	header.version = snapshot_version;
+	header.num_hosts = index_.size();
+	header.index_offset = offset_;
+
+	out_.write(reinterpret_cast<const char*>(index_.data()), static_cast<std::streamsize>(index_.size() * sizeof(WorldSnapshotEntry)));
+	out_.seekp(0);
+	out_.write(reinterpret_cast<const char*>(&header), sizeof(header));
+	out_.close();
+
+	if (!out_)
+	{
+		failed_ = true;
+		return {EIO, std::generic_category()};
+	}
+
+	/* Moved into place only once complete. On Windows this fails while a snapshot at the path is open,
+	which World avoids by writing each snapshot as a new generation (see FileGenerations). */
+	std::error_code ec{};
+	std::filesystem::rename(temp_path_, path_, ec);
+	if (ec)
+		return {EIO, std::generic_category()};
+
+	return {};
+}
+
+/* --- Reader --- */
+
+std::expected<std::shared_ptr<const WorldSnapshot>, std::error_condition> WorldSnapshot::open(const std::filesystem::path& path)
+{
+	auto exp_map = MappedFile::open(path);
+	if (!exp_map)
+		return std::unexpected(exp_map.error());
+
+	std::shared_ptr<WorldSnapshot> snapshot(new WorldSnapshot());
+	snapshot->mapping_ = std::move(exp_map).value();
+	std::string_view file = snapshot->mapping_->view();
+
+	SnapshotHeader header{};
+	if (file.size() < sizeof(header))
+		return std::unexpected(std::error_condition{EINVAL, std::generic_category()});
+
+	std::memcpy(&header, file.data(), sizeof(header));
+
+	if (std::memcmp(header.magic, snapshot_magic, sizeof(header.magic)) != 0
+		|| header.version != snapshot_version
+		|| header.index_offset < sizeof(SnapshotHeader)
+		|| header.index_offset > file.size()
+		|| header.num_hosts != (file.size() - header.index_offset) / sizeof(WorldSnapshotEntry))
+	{
+		return std::unexpected(std::error_condition{EINVAL, std::generic_category()});
+	}
+
+	snapshot->index_.resize(header.num_hosts);
+	std::memcpy(snapshot->index_.data(), file.data() + header.index_offset, header.num_hosts * sizeof(WorldSnapshotEntry));
+
+	for (std::size_t i = 0; i < snapshot->index_.size(); ++i)
+	{
+		const WorldSnapshotEntry& entry = snapshot->index_[i];
+
+		/* Checked here, so that read_host can trust the index. */
+		if (entry.offset < sizeof(SnapshotHeader) || entry.offset > header.index_offset
+			|| entry.size > header.index_offset - entry.offset || entry.size > INT_MAX)
+		{
+			return std::unexpected(std::error_condition{EINVAL, std::generic_category()});
+		}
+
+		snapshot->index_of_[Uid64(entry.uid)] = i;
+	}
+
+	return snapshot;
+}
+
+std::error_condition WorldSnapshot::read_host(Uid64 id, world::Host* to) const
+{
+	auto it = index_of_.find(id);
+	if (it == index_of_.end())
+		return {ENOENT, std::generic_category()};
+
+	const WorldSnapshotEntry& entry = index_[it->second];
+	const char* data = mapping_->view().data() + entry.offset;
+
+	if (!to->ParseFromArray(data, static_cast<int>(entry.size)))
+		return {EINVAL, std::generic_category()};
+
+	return {};
+}
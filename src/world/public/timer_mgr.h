@@ -5,10 +5,13 @@
 #include "soa_helpers.h"
 #include "task.h"
 
-#include <set>
 #include <coroutine>
 #include <vector>
+#include <queue>
 #include <mutex>
+#include <optional>
+#include <functional>
+#include <limits>
 
 class TimerManager;
 
@@ -17,69 +20,132 @@ using timer_container_t = std::vector<T, std::allocator<T>>;
 
 enum TimerManagerComponents : uint8_t
 {
-	ComTimerLengthSeconds,
-    ComTimerSecondsRemaining,
+	ComTimerLength,
+    ComTimerExpiry,
+    ComTimerOrder,
     ComTimerInvoker,
 	ComTimerAlive,
 	ComTimerPaused,
-	ComTimerLooping
+	ComTimerLooping,
+	ComTimerGeneration,
+	ComTimerNextFree
 };
 
 template<typename ... T>
 struct TimerManagerData : public std::tuple<T ...>
 {
 	using std::tuple<T...>::tuple;
- 	auto& get_length() { return std::get<ComTimerLengthSeconds>(*this); }
-	auto& get_remaining() { return std::get<ComTimerSecondsRemaining>(*this); }
+ 	auto& get_length() { return std::get<ComTimerLength>(*this); }
+	auto& get_expiry() { return std::get<ComTimerExpiry>(*this); }
+	auto& get_order() { return std::get<ComTimerOrder>(*this); }
  	auto& get_invoker() { return std::get<ComTimerInvoker>(*this); }
 	auto& get_alive() { return std::get<ComTimerAlive>(*this); }
 	auto& get_paused() { return std::get<ComTimerPaused>(*this); }
 	auto& get_looping() { return std::get<ComTimerLooping>(*this); }
+	auto& get_generation() { return std::get<ComTimerGeneration>(*this); }
+	auto& get_next_free() { return std::get<ComTimerNextFree>(*this); }
 };
 
 using TimerManagerDataTypes = TimerManagerData<
-	float,
-	float,
-	TimerCallbackFn, 
-	uint8_t, 
+	TimerDuration,
+	TimerTimePoint,
+	uint64_t,
+	TimerCallbackFn,
 	uint8_t,
-	uint8_t>;
+	uint8_t,
+	uint8_t,
+	uint32_t,
+	std::size_t>;
 
 using TimerManagerContainer = BaseContainer<timer_container_t, DataLayout::SoA, TimerManagerDataTypes>;
 
+using TimerScheduleFn = std::function<void(TimerTimePoint)>;
+
+/* An entry in the deadline queue. Entries are never removed early;
+an entry whose order no longer matches its slot (cancelled, paused or re-armed) is skipped when popped. */
+struct TimerQueueEntry
+{
+	TimerTimePoint expiry{};
+	uint64_t order{0};
+	std::size_t idx{0};
+
+	friend bool operator > (const TimerQueueEntry& a, const TimerQueueEntry& b)
+	{
+		return (a.expiry != b.expiry) ? a.expiry > b.expiry : a.order > b.order;
+	}
+};
+
+using TimerQueue = std::priority_queue<TimerQueueEntry, std::vector<TimerQueueEntry>, std::greater<TimerQueueEntry>>;
+
 class TimerManager : public ITimerBase
 {
 public:
 
 	TimerManager() = default;
 
-	void step(float delta_seconds);
+	/* Fire every timer whose deadline is at or before 'now'.
+	Cost is proportional to the number of expired timers, not the number of pending ones.
+	Only one thread may step (and query get_next_expiry) at a time; any thread may set timers. */
+	void step(TimerTimePoint now = TimerClock::now());
 
-	/* Set a timer (in seconds), giving a timer handle back. 
-	The event callback will be called once the timer reaches 0. */
-	TimerHandle set_timer(float seconds, TimerCallbackFn event, bool looping = false) override;
+	/* Set a timer, giving a timer handle back.
+	The event callback will be called once the length has passed.
+	Safe to call from any thread, and from within timer callbacks; the timer joins the
+	deadline queue at the start of the next step. */
+	TimerHandle set_timer(TimerDuration length, TimerCallbackFn event, bool looping = false) override;
+	void set_timer(TimerDuration length, TimerCallbackFn event, TimerHandle& out) override;
 
-	/* Pause a set timer without cancelling it. 
+	/* Pause a set timer without cancelling it.
 	If the handle is invalid, nothing happens. */
-	void pause_timer(const TimerHandle& handle);
+	void pause_timer(const TimerHandle& handle) override;
 
-	/* Cancel a timer.
-	If the handle is invalid, nothing happens. */
-	void cancel_timer(const TimerHandle& handle);
+	/* Cancel a timer, so that its callback is never called.
+	Returns false if the handle is invalid or the timer is no longer pending. */
+	bool cancel_timer(const TimerHandle& handle) override;
 
-	bool is_valid_handle(const TimerHandle& handle)
-	{
-		return (handle.idx >= 0 && handle.idx < static_cast<int32_t>(timers_.size()));
-	};
+	bool is_valid_handle(const TimerHandle& handle) override;
 
-	TimerAwaiter wait(float seconds);
+	TimerAwaiter wait(TimerDuration length);
+
+	/* Deadline of the earliest pending timer, or nullopt if no timer is pending. */
+	std::optional<TimerTimePoint> get_next_expiry() const;
+
+	/* Number of timers currently set (including paused ones). */
+	std::size_t get_num_pending() const;
+
+	/* Register a callback invoked (outside the lock) whenever a timer is set,
+	with its deadline. Lets a sleeping scheduler wake for earlier deadlines. */
+	void set_schedule_callback(TimerScheduleFn&& fn) { on_schedule_ = std::move(fn); }
 
 private:
 
-	void reset_timer_internal(std::size_t idx);
+	void merge_staged();
+	void set_timer_internal(TimerDuration length, TimerCallbackFn&& event, bool looping, TimerHandle& out);
+	void stage_timer_internal(std::size_t idx, TimerTimePoint expiry);
 	void kill_timer_internal(std::size_t idx);
+	bool is_live_entry(const TimerQueueEntry& entry);
+	bool is_valid_handle_internal(const TimerHandle& handle);
+
+	static constexpr std::size_t no_free_slot = std::numeric_limits<std::size_t>::max();
 
 	mutable std::mutex mutex_{};
 	TimerManagerContainer timers_{};
-	std::set<std::size_t> free_instances_{};
-};
\ No newline at end of file
+
+	/* Dead slots form a singly-linked list through their NextFree component. */
+	std::size_t free_head_{no_free_slot};
+
+	uint64_t order_counter_{0};
+	std::size_t num_alive_{0};
+
+	/* New and re-armed timers are appended to the staging buffer under the lock,
+	and swapped out and merged into the queue at the start of each step. */
+	std::vector<TimerQueueEntry> staging_{};
+	std::vector<TimerQueueEntry> merging_{};
+	std::optional<TimerTimePoint> staged_expiry_{};
+
+	/* Owned by the stepping thread. */
+	TimerQueue queue_{};
+	std::vector<TimerQueueEntry> rearm_{};
+
+	TimerScheduleFn on_schedule_{nullptr};
+};
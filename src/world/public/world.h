@@ -3,25 +3,94 @@
 #include "timer_mgr.h"
 #include "game_srv.h"
 #include "msg_queue.h"
+#include "run_queue.h"
+#include "world_shard.h"
 #include "link_srv.h"
 #include "uid64.h"
 #include "host.h"
+#include "world_snapshot.h"
 
 #include "proto/world.pb.h"
 
 #include <memory>
 #include <vector>
 #include <thread>
+#include <atomic>
+#include <chrono>
+#include <deque>
+#include <mutex>
+#include <condition_variable>
+#include <stop_token>
+#include <filesystem>
+#include <system_error>
+#include <unordered_set>
 
 using MessageFn = std::function<void(void)>;
 using WorldUpdateQueue = MessageQueue<MessageFn>;
 
+enum class WorldQueueMode : uint8_t
+{
+    Single,     // Pop at most one message per tick.
+    Batched     // Take the whole pending batch per tick, bounded by the budget.
+};
+
+struct WorldQueueParams
+{
+    WorldQueueMode mode{WorldQueueMode::Batched};
+
+    /* Per-tick budget. Messages left over when the budget runs out
+    are kept in order and run first on the next tick. Zero means unbounded. */
+    std::size_t max_messages{0};
+    std::chrono::microseconds max_time{0};
+};
+
+enum class WorldTickMode : uint8_t
+{
+    Polling,    // Step with the measured delta, then sleep for a millisecond.
+    Fixed,      // Step in fixed increments, using an accumulator.
+    SemiFixed   // Step with the measured delta (split at the timestep), sleep until the next timer.
+};
+
+struct WorldTickParams
+{
+    WorldTickMode mode{WorldTickMode::SemiFixed};
+
+    /* Fixed step length, or the largest single step in semi-fixed mode. */
+    std::chrono::microseconds timestep{10000};
+
+    /* Longest sleep when nothing is scheduled (semi-fixed mode). */
+    std::chrono::microseconds max_sleep{100000};
+
+    /* Steps run per wake-up before the remaining backlog is dropped. */
+    uint32_t max_steps{8};
+};
+
+struct WorldShardParams
+{
+    /* Worker threads the hosts are partitioned across, each with its own timers.
+    With one, every host runs on the single world worker. */
+    uint32_t num_shards{1};
+
+    /* Let idle shards run ready hosts of busy ones. */
+    bool steal{true};
+};
+
+struct WorldQueueStats
+{
+    std::atomic<std::size_t> depth{0};          // Messages pending at the start of the last tick.
+    std::atomic<std::size_t> peak_depth{0};
+    std::atomic<uint64_t> drained{0};           // Total messages run.
+    std::atomic<uint64_t> last_drain_us{0};     // Time spent running messages last tick.
+    std::atomic<uint64_t> peak_drain_us{0};
+};
+
 class World
 {
 public:
 
     World() = default;
     World(World&) = delete;
+    ~World();
 
 public:
 
@@ -32,25 +101,105 @@ public:
 
     LinkServer& get_link_server() { return net_; }
     WorldUpdateQueue& get_update_queue() { return queue_; }
+    const WorldQueueStats& get_queue_stats() const { return queue_stats_; }
+    const RunQueueStats& get_run_queue_stats() const { return run_queue_.get_stats(); }
     TimerManager& get_timer_manager() { return timers_; }
 
     Host* add_host(Uid64 id, std::unique_ptr<Host>&& new_host);
 
+    /* Configure how the update queue is drained. Set before launch(). */
+    void set_queue_params(const WorldQueueParams& params) { queue_params_ = params; }
+
+    /* Configure how the world worker steps and sleeps. Set before launch(). */
+    void set_tick_params(const WorldTickParams& params) { tick_params_ = params; }
+
+    /* Configure sharding. Set before adding any hosts. */
+    void set_shard_params(const WorldShardParams& params);
+
+    std::size_t get_num_shards() const { return shards_.size(); }
+    const WorldShard* get_shard(std::size_t idx) const { return shards_[idx].get(); }
+
+    /* Push a message onto the update queue and wake the world worker. */
+    void post(MessageFn&& fn);
+
+    /* Wake the world worker early, if it is sleeping. */
+    void wake();
+
     bool serialize(world::World* to);
     bool deserialize(const world::World* from);
 
+    /* An incremental save: only the hosts whose files changed since the last save, with only those changes.
+    Load it with deserialize on top of the snapshots before it. */
+    bool serialize_changes(world::World* to);
+
+    /* Save every host's file system as an image named by its uid in a directory, or map them back in.
+    Each save is a new generation (see FileGenerations), and loads read the newest one.
+    A host without an image is left alone. Like serialize, call these while the hosts are not running. */
+    std::error_condition save_images(const std::filesystem::path& dir) const;
+    std::error_condition load_images(const std::filesystem::path& dir);
+
+    /* Save every host as its own record in a snapshot file (see WorldSnapshotWriter), or load them back.
+    As with images, 'path' names a series of generations, and loads read the newest.
+    Up to num_threads hosts are serialized or parsed at once; zero means one per core.
+    Like serialize, call these while the hosts are not running. */
+    std::error_condition save_snapshot(const std::filesystem::path& path, std::size_t num_threads = 0);
+    std::error_condition load_snapshot(const std::filesystem::path& path, std::size_t num_threads = 0);
+
+    /* Open a snapshot without loading anything, so that each host can be loaded on demand with load_host,
+    before it is first started. Hosts not in the snapshot are left alone. */
+    std::error_condition open_snapshot(const std::filesystem::path& path);
+
+    /* Load a host from the open snapshot, once. False if there is nothing (left) to load for it. */
+    bool load_host(Uid64 id);
+
 private:
 
-    const float min_timestep{0.01f};
+    /* Runs pending update queue messages within the configured budget.
+    Returns the number of messages run. */
+    std::size_t drain_queue();
+
+    /* One iteration of the worker loop: step the world, then sleep. */
+    void tick(std::stop_token stop);
+
+    /* Sleep until the deadline, a stop request or a call to wake(). */
+    void sleep_until(std::stop_token stop, std::chrono::steady_clock::time_point deadline);
 
     bool run_{true};
     std::jthread worker_{};
+
+    /* Set by the worker itself, since worker_ may still be being assigned when other threads first ask. */
+    std::atomic<std::thread::id> worker_id_{};
     std::chrono::steady_clock::time_point last_update_{};
+    std::chrono::duration<float> accumulator_{0};
+
+    WorldTickParams tick_params_{};
+    std::mutex wake_mutex_{};
+    std::condition_variable_any wake_cv_{};
+    bool wake_pending_{false};
+    /* Deadline of the current sleep; the maximum while the worker is awake,
+    so that timers set concurrently always force another pass. */
+    std::atomic<std::chrono::steady_clock::rep> sleep_deadline_{std::chrono::steady_clock::duration::max().count()};
     std::unordered_map<Uid64, std::unique_ptr<Host>> hosts_{};
 
+    /* The snapshot opened for lazy loading, and the hosts in it not yet loaded. */
+    std::mutex snapshot_lock_{};
+    std::shared_ptr<const WorldSnapshot> snapshot_{nullptr};
+    std::unordered_set<Uid64> unloaded_hosts_{};
+
+    /* Empty unless sharded. Declared after the hosts, so workers stop before hosts are destroyed. */
+    WorldShardParams shard_params_{};
+    std::vector<std::unique_ptr<WorldShard>> shards_{};
+
     TimerManager timers_{};
+
+    /* Coroutines suspended on the world thread are resumed from here, once per update. */
+    RunQueue run_queue_{};
+
     LinkServer net_{};
     WorldUpdateQueue queue_{};
+    WorldQueueParams queue_params_{};
+    WorldQueueStats queue_stats_{};
+    std::deque<MessageFn> pending_{};
 
     GameServices services_
     {
@@ -0,0 +1,118 @@
+#pragma once
+
+#include "timer_mgr.h"
+#include "game_srv.h"
+#include "run_queue.h"
+
+#include <memory>
+#include <vector>
+#include <deque>
+#include <thread>
+#include <atomic>
+#include <chrono>
+#include <mutex>
+#include <condition_variable>
+#include <stop_token>
+
+class Host;
+class WorldShard;
+
+/* The executor of a single host in a sharded world.
+Every coroutine of the host resumes through its run queue, and the strand is only ever
+run by one worker at a time: usually its home shard, unless an idle shard steals it. */
+struct HostStrand
+{
+    Host* host{nullptr};
+    WorldShard* home{nullptr};
+    RunQueue queue{};
+
+    /* Set while the strand is queued on its home shard or running. */
+    std::atomic<bool> scheduled{false};
+};
+
+struct WorldShardStats
+{
+    std::atomic<uint64_t> ticks{0};
+    std::atomic<uint64_t> strands_run{0};   // Including stolen ones.
+    std::atomic<uint64_t> stolen{0};        // Strands of other shards run by this one.
+};
+
+/* One worker of a sharded world: a thread with its own timer manager,
+driving the hosts assigned to it. */
+class WorldShard
+{
+public:
+
+    explicit WorldShard(uint32_t index);
+    WorldShard(WorldShard&) = delete;
+
+    uint32_t get_index() const { return index_; }
+    GameServices* get_services() { return &services_; }
+    TimerManager& get_timer_manager() { return timers_; }
+    const WorldShardStats& get_stats() const { return stats_; }
+
+    /* Assign a host to this shard, giving back the strand to use as its executor. */
+    HostStrand* adopt(Host* host);
+
+    /* Initialise every host on this shard with the shard's services. */
+    void init_hosts();
+
+    /* Set the shards this one may steal from (including itself, which is skipped).
+    Call on every shard before launching any of them. */
+    void connect(std::vector<WorldShard*> siblings, bool steal, std::chrono::microseconds max_sleep);
+
+    /* Start the worker. */
+    void launch();
+
+    /* Stop and join the worker. Stop every shard before destroying any, as they steal from each other. */
+    void stop();
+
+    /* Queue a strand that has coroutines ready. Safe from any thread. */
+    void schedule(HostStrand& strand);
+
+    /* Wake the worker early, if it is sleeping. */
+    void wake();
+
+private:
+
+    /* One iteration of the worker loop: timers, ready strands, stealing, then sleep. */
+    void tick(std::stop_token stop);
+
+    void run_strand(HostStrand& strand);
+    HostStrand* pop_ready();
+    HostStrand* steal_ready();
+    HostStrand* try_steal();
+
+    void sleep_until(std::stop_token stop, std::chrono::steady_clock::time_point deadline);
+
+    uint32_t index_{0};
+
+    TimerManager timers_{};
+    GameServices services_
+    {
+        .timers = timers_
+    };
+
+    std::vector<std::unique_ptr<HostStrand>> strands_{};
+
+    std::mutex ready_mutex_{};
+    std::deque<HostStrand*> ready_{};
+
+    std::vector<WorldShard*> siblings_{};
+    bool steal_{true};
+    std::chrono::microseconds max_sleep_{100000};
+
+    std::mutex wake_mutex_{};
+    std::condition_variable_any wake_cv_{};
+    bool wake_pending_{false};
+    std::atomic<std::chrono::steady_clock::rep> sleep_deadline_{std::chrono::steady_clock::duration::max().count()};
+
+    WorldShardStats stats_{};
+
+    /* The worker's own id, for the schedule callback; worker_ itself is not safe to read while launch() assigns it. */
+    std::atomic<std::thread::id> worker_id_{};
+
+    /* Declared last, so the worker stops before anything it uses is destroyed. */
+    std::jthread worker_{};
+
+};
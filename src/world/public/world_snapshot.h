@@ -0,0 +1,84 @@
+#pragma once
+
+#include "uid64.h"
+
+#include <cstdint>
+#include <memory>
+#include <vector>
+#include <string>
+#include <mutex>
+#include <fstream>
+#include <expected>
+#include <filesystem>
+#include <system_error>
+#include <unordered_map>
+
+namespace world { class Host; }
+
+class MappedFile;
+
+/* Where one host's record sits in a snapshot. */
+struct WorldSnapshotEntry
+{
+    uint64_t uid{0};
+    uint64_t offset{0};     // Of the serialized world::Host, from the start of the file.
+    uint64_t size{0};
+};
+
+/* Writes a world snapshot one host at a time: a header, then each host as its own
+length-delimited world::Host record, then an index of the records that the header points at.
+Only one host's message is held in memory per caller, and no single message holds the world,
+so the snapshot is bounded by the disk rather than by protobuf's 2 GB message limit. */
+class WorldSnapshotWriter
+{
+public:
+
+    static std::expected<std::unique_ptr<WorldSnapshotWriter>, std::error_condition> create(const std::filesystem::path& path);
+
+    WorldSnapshotWriter(const WorldSnapshotWriter&) = delete;
+    WorldSnapshotWriter& operator = (const WorldSnapshotWriter&) = delete;
+
+    ~WorldSnapshotWriter();
+
+    /* Appends a host's record. Safe to call from several threads; records land in the order they finish. */
+    std::error_condition add_host(Uid64 id, const world::Host& host);
+
+    /* Writes the index and moves the snapshot into place. Nothing is visible at the path until this succeeds. */
+    std::error_condition finish();
+
+private:
+
+    WorldSnapshotWriter() = default;
+
+    std::filesystem::path path_{};
+    std::filesystem::path temp_path_{};
+
+    std::mutex write_lock_{};
+    std::ofstream out_{};
+    uint64_t offset_{0};
+    std::vector<WorldSnapshotEntry> index_{};
+    bool failed_{false};
+};
+
+/* A snapshot opened for reading. Only the header and index are read up front;
+the file is mapped, so a host's record is paged in when it is asked for and not before. */
+class WorldSnapshot
+{
+public:
+
+    static std::expected<std::shared_ptr<const WorldSnapshot>, std::error_condition> open(const std::filesystem::path& path);
+
+    const std::vector<WorldSnapshotEntry>& get_index() const { return index_; }
+    bool contains(Uid64 id) const { return index_of_.contains(id); }
+
+    /* Parses one host's record. Safe to call from several threads. */
+    std::error_condition read_host(Uid64 id, world::Host* to) const;
+
+private:
+
+    WorldSnapshot() = default;
+
+    std::shared_ptr<const MappedFile> mapping_{nullptr};
+    std::vector<WorldSnapshotEntry> index_{};
+    std::unordered_map<Uid64, std::size_t> index_of_{};
+};